@@ -193,6 +193,7 @@ void soundInterrupt(void)
     // flag
     int flag = node->flag;
     node->flag |= PROCESSED;
+    wakeup(&soundQueue); // waitSound()
 
     // 0 sound file left
     if (soundQueue == 0)
@@ -268,6 +269,32 @@ void addSound(struct soundNode *node)
     release(&sound_lock);
 }
 
+// Sleep until soundInterrupt() has finished playing one of
+// the n nodes. Returns -1 if the process is killed.
+int waitSound(struct soundNode *nodes, int n)
+{
+    int i;
+
+    acquire(&sound_lock);
+    for (;;)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if ((nodes[i].flag & PROCESSED) == PROCESSED)
+            {
+                release(&sound_lock);
+                return 0;
+            }
+        }
+        if (myproc()->killed)
+        {
+            release(&sound_lock);
+            return -1;
+        }
+        sleep(&soundQueue, &sound_lock);
+    }
+}
+
 void ac97_pause(int isPaused)
 {
     if (isPaused == 1)
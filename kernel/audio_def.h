@@ -31,8 +31,9 @@ struct wav{
 struct soundNode{
   volatile int flag;
   struct soundNode *next;
-  uchar data[DMA_BUF_NUM*DMA_BUF_SIZE];
+  uchar *data; // DMA_BUF_NUM*DMA_BUF_SIZE bytes, from bd_alloc()
 };
 
 void addSound(struct soundNode *node);
+int waitSound(struct soundNode *nodes, int n);
 
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,6 +12,13 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// Each buffer sits in the bucket that (dev, blockno) hashes to,
+// and each bucket has its own lock, so lookups of different
+// blocks rarely contend. A miss recycles the least recently
+// released unused buffer in the whole cache, moving it between
+// buckets; it holds only one bucket lock at a time while doing
+// so, and so there is no global lock.
 
 
 #include "types.h"
@@ -23,69 +30,221 @@
 #include "fs.h"
 #include "buf.h"
 
-struct {
+#define NBUCKET 13
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+
+struct bucket {
   struct spinlock lock;
+  struct buf *head;  // buffers in this bucket, through next
+  uint hits;
+  uint misses;
+};
+
+struct {
   struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
+  int nprefetch;  // buffers held by bprefetch() reads in flight
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // for bevict() to wait for a buffer when all are in use.
+  struct spinlock waitlock;
+  int nwait;      // bevict()s waiting
+  uint nfreed;    // times a buffer's refcnt has dropped to 0
 } bcache;
 
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+}
+
+static void
+binsert(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head;
+  bk->head = b;
+}
+
 void
 binit(void)
 {
+  struct bucket *bk;
   struct buf *b;
 
-  initlock(&bcache.lock, "bcache");
-
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache");
+  initlock(&bcache.waitlock, "bcache_wait");
+  // spread the (invalid) buffers over the buckets.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    binsert(&bcache.bucket[(b - bcache.buf) % NBUCKET], b);
+  }
+}
+
+// Return the least recently released unused buffer in bk,
+// or 0 if there is none. Caller must hold bk->lock.
+static struct buf*
+blru(struct bucket *bk)
+{
+  struct buf *b, *lru = 0;
+
+  for(b = bk->head; b; b = b->next)
+    if(b->refcnt == 0 && (lru == 0 || b->lastuse < lru->lastuse))
+      lru = b;
+  return lru;
+}
+
+// Take the least recently used unused buffer out of whatever
+// bucket it is in, marked in use. Locks one bucket at a time,
+// so the choice can go stale; it is made again under the
+// chosen bucket's lock. If every buffer is in use, e.g.
+// pinned by the log or held by read-ahead, wait until one
+// is released, or return 0 if mayfail is set.
+static struct buf*
+bevict(int mayfail)
+{
+  struct bucket *bk, *best;
+  struct buf *b;
+  uint bestuse = 0, nfreed;
+
+  for(;;){
+    nfreed = __sync_fetch_and_add(&bcache.nfreed, 0);
+    best = 0;
+    for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+      acquire(&bk->lock);
+      b = blru(bk);
+      if(b && (best == 0 || b->lastuse < bestuse)){
+        best = bk;
+        bestuse = b->lastuse;
+      }
+      release(&bk->lock);
+    }
+    if(best == 0){
+      if(mayfail)
+        return 0;
+      // bunref() counts nfreed before it looks at nwait, so
+      // either it sees this waiter or the check sees its count.
+      acquire(&bcache.waitlock);
+      bcache.nwait++;
+      __sync_synchronize();
+      while(bcache.nfreed == nfreed)
+        sleep(&bcache.nwait, &bcache.waitlock);
+      bcache.nwait--;
+      release(&bcache.waitlock);
+      continue;
+    }
+
+    acquire(&best->lock);
+    if((b = blru(best)) != 0){
+      bunlink(best, b);
+      b->refcnt = 1;
+      release(&best->lock);
+      return b;
+    }
+    release(&best->lock);
   }
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
-// In either case, return locked buffer.
+// In either case, return locked buffer; except that if
+// onlynew is set, return 0 if the block is already cached
+// or there are no buffers to spare.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int onlynew)
 {
-  struct buf *b;
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
+  struct buf *b, *victim;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
+      if(onlynew){
+        release(&bk->lock);
+        return 0;
+      }
       b->refcnt++;
-      release(&bcache.lock);
+      bk->hits++;
+      release(&bk->lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
+  bk->misses++;
+  release(&bk->lock);
 
   // Not cached.
   // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
+  if((victim = bevict(onlynew)) == 0)
+    return 0;
+  // the victim is in no bucket, so no one else can have
+  // locked it; lock it now so that the caller is sure to be
+  // the one to fill it.
+  acquiresleep(&victim->lock);
+
+  acquire(&bk->lock);
+  // another process may have cached the block meanwhile.
+  for(b = bk->head; b; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      // park the victim here, unused. its old block might
+      // hash here too, and be cached again later, so take
+      // away its identity lest a lookup match it.
+      releasesleep(&victim->lock);
+      victim->dev = victim->blockno = ~0;
+      victim->valid = 0;
+      victim->refcnt = 0;
+      binsert(bk, victim);
+      if(onlynew){
+        release(&bk->lock);
+        return 0;
+      }
+      b->refcnt++;
+      release(&bk->lock);
       acquiresleep(&b->lock);
       return b;
     }
   }
-  panic("bget: no buffers");
+  b = victim;
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  binsert(bk, b);
+  release(&bk->lock);
+  return b;
+}
+
+// Return a locked buf for a block that the caller will
+// overwrite completely. Like bread(), but doesn't read the
+// old contents from disk.
+struct buf*
+bgetnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  b->valid = 1;
+  return b;
+}
+
+// Is the block in the cache? The answer can go stale unless
+// the caller somehow keeps others from reading the block.
+int
+bcached(uint dev, uint blockno)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
+  struct buf *b;
+
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bk->lock);
+  return b != 0;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,7 +253,7 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
@@ -102,6 +261,77 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Start reading n blocks into the cache without waiting for
+// them, skipping any that are cached already. The disk is
+// told about all of them at once, and runs of consecutive
+// blocks go in single requests. For read-ahead; n is at most
+// NPREFETCH. At most NPREFETCH buffers are held by reads
+// in flight, from all callers together; past that, the rest
+// of the blocks are skipped, so that read-ahead can't take
+// the buffers that ordinary reads and the log need.
+void
+bprefetch(uint dev, uint *blocknos, int n)
+{
+  struct buf *b, *bs[NPREFETCH];
+  int nb = 0;
+
+  if(n > NPREFETCH)
+    panic("bprefetch");
+  for(int i = 0; i < n; i++){
+    if(__sync_fetch_and_add(&bcache.nprefetch, 1) >= NPREFETCH){
+      __sync_fetch_and_sub(&bcache.nprefetch, 1);
+      break;
+    }
+    if((b = bget(dev, blocknos[i], 1)) != 0)
+      bs[nb++] = b;
+    else
+      __sync_fetch_and_sub(&bcache.nprefetch, 1);
+  }
+  if(nb > 0){
+    virtio_disk_start(bs, nb, 0, 1);
+    virtio_disk_kick();
+  }
+}
+
+// Drop a reference to b, whose sleep-lock is already released.
+static void
+bunref(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  int freed;
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  freed = b->refcnt == 0;
+  if (freed) {
+    // no one is waiting for it.
+    b->lastuse = ticks;
+  }
+  release(&bk->lock);
+
+  if(freed){
+    __sync_fetch_and_add(&bcache.nfreed, 1);
+    if(bcache.nwait > 0){
+      acquire(&bcache.waitlock);
+      wakeup(&bcache.nwait);
+      release(&bcache.waitlock);
+    }
+  }
+}
+
+// The disk driver calls this from its interrupt handler when
+// a bprefetch() read has finished. No process holds b's
+// sleep-lock, so it can't go through brelse().
+void
+bprefetchdone(struct buf *b)
+{
+  b->valid = 1;
+  releasesleep(&b->lock);
+  bunref(b);
+  __sync_fetch_and_sub(&bcache.nprefetch, 1);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,8 +341,26 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write n locked buffers to disk, giving the device all of
+// the requests at once rather than one at a time. Buffers
+// for consecutive blocks should be next to each other in bs,
+// so that they can share a request.
+void
+bwritemany(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritemany");
+  virtio_disk_start(bs, n, 1, 0);
+  virtio_disk_kick();
+  for(i = 0; i < n; i++)
+    virtio_disk_wait(bs[i]);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Stamp it with the time, for LRU recycling.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +368,36 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
-
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  bunref(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
-  b->refcnt--;
-  release(&bcache.lock);
+  bunref(b);
 }
 
+// Print hit rate and bucket lock contention.
+// Runs when user types ^T on console.
+void
+bcachestats(void)
+{
+  uint hits = 0, misses = 0, n = 0, nts = 0;
 
+  for(struct bucket *bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    hits += bk->hits;
+    misses += bk->misses;
+    n += bk->lock.n;
+    nts += bk->lock.nts;
+  }
+  printf("bcache: %d hits, %d misses\n", hits, misses);
+  printf("bcache: lock acquires %d, contended spins %d\n", n, nts);
+}
@@ -0,0 +1,125 @@
+// Buddy allocator for physically contiguous, naturally aligned
+// blocks of 2^k pages, such as DMA buffers, which kalloc()'s
+// single pages can't provide. It manages the top of RAM, from
+// BUDDYSTART to PHYSTOP, which kinit() leaves out of the page
+// allocator.
+//
+// A free block of order k sits on free[k]. Freeing a block
+// merges it with its buddy (the other half of the order k+1
+// block containing it) for as long as that buddy is free too.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BDPAGES  ((PHYSTOP - BUDDYSTART) / PGSIZE)
+#define MAXORDER 11  // largest block is 2^(MAXORDER-1) pages
+
+struct bdblock {
+  struct bdblock *next;
+  struct bdblock *prev;
+};
+
+static struct {
+  struct spinlock lock;
+  struct bdblock free[MAXORDER]; // circular free lists, one per order
+  uchar order[BDPAGES];          // order of the block at each page
+  uchar isfree[BDPAGES];         // is that block on a free list?
+} bd;
+
+#define BDINDEX(b) (((uint64)(b) - BUDDYSTART) / PGSIZE)
+#define BDADDR(i)  ((struct bdblock*)(BUDDYSTART + (uint64)(i) * PGSIZE))
+
+static void
+bdpush(int k, struct bdblock *b)
+{
+  b->next = bd.free[k].next;
+  b->prev = &bd.free[k];
+  bd.free[k].next->prev = b;
+  bd.free[k].next = b;
+  bd.order[BDINDEX(b)] = k;
+  bd.isfree[BDINDEX(b)] = 1;
+}
+
+static void
+bdremove(struct bdblock *b)
+{
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+  bd.isfree[BDINDEX(b)] = 0;
+}
+
+void
+bdinit(void)
+{
+  uint64 a;
+
+  initlock(&bd.lock, "buddy");
+  for(int k = 0; k < MAXORDER; k++)
+    bd.free[k].next = bd.free[k].prev = &bd.free[k];
+  for(a = BUDDYSTART; a < PHYSTOP; a += (uint64)PGSIZE << (MAXORDER-1))
+    bdpush(MAXORDER-1, (struct bdblock*)a);
+}
+
+// Allocate a physically contiguous region of at least n bytes,
+// aligned to its (power of two) size. The memory is not zeroed.
+// Returns 0 if no large enough block is free.
+void*
+bd_alloc(uint64 n)
+{
+  struct bdblock *b;
+  int j, k;
+
+  for(k = 0; ((uint64)PGSIZE << k) < n; k++)
+    if(k == MAXORDER-1)
+      return 0;
+
+  acquire(&bd.lock);
+  for(j = k; j < MAXORDER && bd.free[j].next == &bd.free[j]; j++)
+    ;
+  if(j == MAXORDER){
+    release(&bd.lock);
+    return 0;
+  }
+  b = bd.free[j].next;
+  bdremove(b);
+  // split, returning the upper halves to the free lists.
+  while(j > k){
+    j--;
+    bdpush(j, (struct bdblock*)((char*)b + ((uint64)PGSIZE << j)));
+  }
+  bd.order[BDINDEX(b)] = k;
+  release(&bd.lock);
+  return (void*)b;
+}
+
+// Free a region returned by bd_alloc().
+void
+bd_free(void *p)
+{
+  uint64 i, bi;
+  int k;
+
+  if(((uint64)p % PGSIZE) != 0 || (uint64)p < BUDDYSTART || (uint64)p >= PHYSTOP)
+    panic("bd_free");
+
+  acquire(&bd.lock);
+  i = BDINDEX(p);
+  k = bd.order[i];
+  if(bd.isfree[i])
+    panic("bd_free: free");
+  while(k < MAXORDER-1){
+    bi = i ^ (1L << k);
+    if(!bd.isfree[bi] || bd.order[bi] != k)
+      break;
+    bdremove(BDADDR(bi));
+    if(bi < i)
+      i = bi;
+    k++;
+  }
+  bdpush(k, BDADDR(i));
+  release(&bd.lock);
+}
@@ -5,8 +5,9 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint lastuse;     // ticks when last released, for LRU
+  struct buf *next; // hash bucket list
+  struct buf *qnext; // next buf in the same disk request
   uchar data[BSIZE];
 };
 
@@ -141,6 +141,14 @@ consoleintr(int c)
   case C('P'):  // Print process list.
     procdump();
     break;
+  case C('T'):  // Print kernel statistics.
+    kallocstats();
+    bcachestats();
+    virtio_disk_stats();
+    logstats();
+    dcachestats();
+    schedstats();
+    break;
   case C('U'):  // Kill line.
     while(cons.e != cons.w &&
           cons.buf[(cons.e-1) % INPUT_BUF] != '\n'){
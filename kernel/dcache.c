@@ -0,0 +1,166 @@
+// Name cache.
+//
+// Caches the results of path-name lookups, so that namex()
+// can resolve a path it has seen before without locking
+// and scanning each directory on the way. An entry maps
+// (dev, directory inum, name) to the inum the name refers to,
+// or to 0 if the directory has no such name (a negative entry).
+//
+// The cache is set-associative: a name hashes to one of
+// NDSET sets of NDWAY entries, and a new entry replaces the
+// least recently used one in its set.
+//
+// Entries go stale when directories change, so:
+// * dirlink() and dirunlink() invalidate the name they change.
+// * freeing an inode purges the entries of the directory it
+//   was, since the inum may be reused.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+
+#define NDSET 64
+#define NDWAY 4
+
+struct dentry {
+  uint dev;
+  uint dir;     // directory inum; 0 if the entry is unused
+  char name[DIRSIZ];
+  uint inum;    // 0 for a negative entry
+  uint lastuse;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry set[NDSET][NDWAY];
+  uint clock;   // stamps lastuse
+
+  // statistics
+  uint hits;
+  uint neghits;
+  uint misses;
+} dcache;
+
+void
+dcinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dcset(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return dcache.set[h % NDSET];
+}
+
+// Caller must hold dcache.lock.
+static struct dentry*
+dcfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d = dcset(dev, dir, name);
+  int w;
+
+  for(w = 0; w < NDWAY; w++)
+    if(d[w].dir == dir && d[w].dev == dev && namecmp(d[w].name, name) == 0)
+      return &d[w];
+  return 0;
+}
+
+// Look up name in directory dir. Return 1 if the cache knows
+// the answer, setting *ipp to the inode (from iget()), or to 0
+// if there is no such name; return 0 if it doesn't. The iget()
+// happens under the cache lock, so the inode can't be freed
+// in between: dirunlink() invalidates the name first.
+int
+dclookup(uint dev, uint dir, char *name, struct inode **ipp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    dcache.misses++;
+    release(&dcache.lock);
+    return 0;
+  }
+  d->lastuse = ++dcache.clock;
+  if(d->inum){
+    dcache.hits++;
+    *ipp = iget(dev, d->inum);
+  } else {
+    dcache.neghits++;
+    *ipp = 0;
+  }
+  release(&dcache.lock);
+  return 1;
+}
+
+// Remember that name in directory dir is inum, or, if inum
+// is 0, that there is no such name.
+void
+dcenter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d, *set;
+  int w;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    set = dcset(dev, dir, name);
+    d = &set[0];
+    for(w = 1; w < NDWAY; w++)
+      if(set[w].lastuse < d->lastuse)
+        d = &set[w];
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+  }
+  d->inum = inum;
+  d->lastuse = ++dcache.clock;
+  release(&dcache.lock);
+}
+
+// Forget name in directory dir.
+void
+dcinval(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) != 0){
+    d->dir = 0;
+    d->lastuse = 0;
+  }
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dir, which is being freed.
+void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = &dcache.set[0][0]; d < &dcache.set[NDSET][0]; d++){
+    if(d->dir == dir && d->dev == dev){
+      d->dir = 0;
+      d->lastuse = 0;
+    }
+  }
+  release(&dcache.lock);
+}
+
+// Print hit rates.
+// Runs when user types ^T on console.
+void
+dcachestats(void)
+{
+  printf("dcache: %d hits, %d negative hits, %d misses\n",
+         dcache.hits, dcache.neghits, dcache.misses);
+}
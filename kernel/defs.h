@@ -2,6 +2,7 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -12,10 +13,16 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bgetnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bcachestats(void);
+void            bprefetch(uint, uint*, int);
+void            bwritemany(struct buf**, int);
+void            bprefetchdone(struct buf*);
+int             bcached(uint, uint);
 
 // console.c
 void            consoleinit(void);
@@ -32,14 +39,17 @@ struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
+int             filegetdents(struct file*, uint64, int);
 int             filewrite(struct file*, uint64, int n);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -50,10 +60,25 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+void            readahead(struct inode*, uint, uint);
+int             readdirect(struct inode*, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 
+// dcache.c
+void            dcinit(void);
+int             dclookup(uint, uint, char*, struct inode**);
+void            dcenter(uint, uint, char*, uint);
+void            dcinval(uint, uint, char*);
+void            dcpurge(uint, uint);
+void            dcachestats(void);
+
+// shm.c
+void            shminit(void);
+uint64          shmmap(int, int);
+int             shmunlink(int);
+
 // ramdisk.c
 void            ramdiskinit(void);
 void            ramdiskintr(void);
@@ -63,10 +88,29 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kallocstats(void);
+void*           kzalloc(void);
+int             kzeroidle(void);
+void            kref(void *);
+
+// buddy.c
+void            bdinit(void);
+void*           bd_alloc(uint64);
+void            bd_free(void*);
+
+// slab.c
+void            slabinit(void);
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void*           kmalloc(uint64);
+void            kmfree(void*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            logtick(void);
+void            logstats(void);
 void            begin_op(void);
 void            end_op(void);
 
@@ -85,10 +129,16 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             clone(uint64, uint64, uint64);
+int             tgexecstart(struct proc*);
+void            tgexecfail(struct proc*);
 int             growproc(int);
+int             proclazy(struct proc*, uint64);
+uint64          growshared(uint64*, int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freeuser(struct proc*, pagetable_t, uint64);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
@@ -100,10 +150,15 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             wakeupn(void*, int);
+int             futex(uint64, int, int);
 void            yield(void);
+void            kthread(void (*)(void), char*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            schedstats(void);
+void            setrt(int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -146,6 +201,13 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            ipi(int);
+
+// timer.c
+void            hrtinit(void);
+void            hrtexpire(void);
+void            timerset(void);
+int             nanosleep(uint64);
 
 // uart.c
 void            uartinit(void);
@@ -163,6 +225,7 @@ pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
@@ -181,7 +244,12 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_start(struct buf **, int, int, int);
+void            virtio_disk_kick(void);
+void            virtio_disk_wait(struct buf *);
+void            virtio_disk_read_direct(uint, uint64*, uint*, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_stats(void);
 
 // pci.c
 void            pci_init();
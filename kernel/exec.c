@@ -21,10 +21,15 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // other threads can't be using the memory exec() frees.
+  if(tgexecstart(p) < 0)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
+    tgexecfail(p);
     return -1;
   }
   ilock(ip);
@@ -115,7 +120,8 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  proc_freeuser(p, oldpagetable, oldsz);
+  p->tfva = TRAPFRAME;
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -126,6 +132,7 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  tgexecfail(p);
   return -1;
 }
 
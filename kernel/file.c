@@ -12,17 +12,22 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
+
+#define RAMIN 2   // initial read-ahead window, in blocks
+#define RAMAX 32  // largest read-ahead window
 
 struct devsw devsw[NDEV];
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct spinlock lock;     // protects ref counts
+  struct kmem_cache cache;  // file structures, allocated on demand
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -31,16 +36,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +72,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -101,6 +102,105 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Read up to n entries from directory f, starting at its
+// offset, into the struct dirinfo array at user address addr.
+// Returns the number of entries read, 0 at the end of the
+// directory. A batch of dirents is read with the directory
+// locked, taking a reference to each inode so that it can't be
+// freed; the inodes are locked afterwards, one at a time, so
+// that a ".." entry doesn't lock a parent while its child is
+// locked.
+int
+filegetdents(struct file *f, uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct dirent de[8];  // a few, to spare the inode cache
+  struct inode *ips[NELEM(de)];
+  struct dirinfo di;
+  struct stat st;
+  int i, nde, tot;
+
+  if(f->type != FD_INODE || f->readable == 0 || n < 0)
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type != T_DIR){
+    iunlock(f->ip);
+    return -1;
+  }
+  iunlock(f->ip);
+
+  tot = 0;
+  while(tot < n){
+    // collect the next batch of in-use entries.
+    ilock(f->ip);
+    for(nde = 0; nde < NELEM(de) && tot + nde < n && f->off < f->ip->size; f->off += sizeof(de[0])){
+      if(readi(f->ip, 0, (uint64)&de[nde], f->off, sizeof(de[0])) != sizeof(de[0]))
+        break;
+      if(de[nde].inum != 0){
+        ips[nde] = iget(f->ip->dev, de[nde].inum);
+        nde++;
+      }
+    }
+    iunlock(f->ip);
+    if(nde == 0)
+      break;
+
+    // iput() might free an inode unlinked meanwhile.
+    begin_op();
+    for(i = 0; i < nde; i++){
+      ilock(ips[i]);
+      stati(ips[i], &st);
+      iunlockput(ips[i]);
+      if(tot < 0)
+        continue;  // copyout failed; just drop the references
+      di.inum = st.ino;
+      di.type = st.type;
+      di.nlink = st.nlink;
+      di.size = st.size;
+      memmove(di.name, de[i].name, DIRSIZ);
+      di.name[DIRSIZ] = 0;
+      if(copyout(p->pagetable, addr + tot*sizeof(di), (char*)&di, sizeof(di)) < 0)
+        tot = -1;
+      else
+        tot++;
+    }
+    end_op();
+    if(tot < 0)
+      return -1;
+  }
+  return tot;
+}
+
+// Prefetch blocks after a read of f that started at off.
+// A read that starts where the last one ended is sequential,
+// and doubles the read-ahead window, up to RAMAX blocks past
+// the new offset; any other read turns read-ahead off until
+// reads are sequential again. Caller must hold f->ip->lock.
+static void
+fileahead(struct file *f, uint off)
+{
+  uint bn, start;
+
+  if(off != f->ra_next){
+    f->ra_win = 0;
+    f->ra_end = 0;
+  } else if(f->ra_win == 0){
+    f->ra_win = RAMIN;
+  } else if(f->ra_win < RAMAX){
+    f->ra_win *= 2;
+  }
+  f->ra_next = f->off;
+  if(f->ra_win == 0)
+    return;
+
+  bn = f->off / BSIZE;
+  start = f->ra_end > bn ? f->ra_end : bn;
+  if(start < bn + f->ra_win){
+    readahead(f->ip, start, bn + f->ra_win - start);
+    f->ra_end = bn + f->ra_win;
+  }
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -118,9 +218,15 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    uint off = f->off;
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if(f->direct){
+      if((r = readdirect(f->ip, addr, f->off, n)) > 0)
+        f->off += r;
+    } else if((r = readi(f->ip, 1, addr, f->off, n)) > 0){
       f->off += r;
+      fileahead(f, off);
+    }
     iunlock(f->ip);
   } else {
     panic("fileread");
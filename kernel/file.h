@@ -3,16 +3,22 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char direct;       // FD_INODE: read whole blocks without the cache
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  uint ra_next;      // FD_INODE: offset a sequential read would start at
+  uint ra_win;       // read-ahead window in blocks; 0 if not sequential
+  uint ra_end;       // blocks before this have been prefetched
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
+#define NBMAP 16  // file blocks in an inode's bmap cache
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
@@ -27,6 +33,18 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+2];
+
+  // bmap cache: disk addresses of file blocks bmstart..
+  // bmstart+NBMAP-1, copied from an indirect block; 0 if not
+  // known. bmstart is 0 when the cache is empty.
+  uint bmstart;
+  uint bmaddrs[NBMAP];
+
+  // disk address of the block last allocated to the file, so
+  // that its next block can go right after it; 0 if unknown.
+  uint lastalloc;
+
+  struct dirhash *dh; // name index of a large directory, or 0
 };
 
 // map major device number to device functions.
@@ -22,10 +22,24 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define DIRECTRUN 4  // most blocks per O_DIRECT disk request
+#define DIRECTSEG (DIRECTRUN*BSIZE/PGSIZE + 2)  // pages they can touch
+#define NAGROUP 8    // allocation groups
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
+// The data blocks are divided into NAGROUP allocation groups.
+// Each inode allocates in group inum % NAGROUP, so files
+// written at the same time usually land in different parts of
+// the disk rather than interleaving their blocks. The cursors
+// are only hints, and are not stored on disk.
+struct {
+  struct spinlock lock;
+  uint start;            // first data block
+  uint cursor[NAGROUP];  // where the group's next new file starts
+} agroup;
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +58,11 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+
+  initlock(&agroup.lock, "agroup");
+  agroup.start = sb.bmapstart + sb.size/BPB + 1;
+  for(int g = 0; g < NAGROUP; g++)
+    agroup.cursor[g] = agroup.start + g * ((sb.size - agroup.start) / NAGROUP);
 }
 
 // Zero a block.
@@ -60,29 +79,74 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Mark the first free block in [from, to) in use and return
+// it, or return 0 if there is none. Skips full bitmap bytes
+// eight blocks at a time.
 static uint
-balloc(uint dev)
+bscan(uint dev, uint from, uint to)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b, end;
+  int bi, m;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  for(b = from; b < to; b = end){
+    end = min(to, (b/BPB + 1) * BPB);
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+    for(; b < end; b++){
+      bi = b % BPB;
+      if(bi % 8 == 0 && b + 8 <= end && bp->data[bi/8] == 0xff){
+        b += 7;  // a full byte
+        continue;
+      }
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        return b;
       }
     }
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  return 0;
+}
+
+// Allocate a zeroed disk block, the first free one at or
+// after goal, wrapping around to the start of the data blocks.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b;
+
+  if(goal < agroup.start || goal >= sb.size)
+    goal = agroup.start;
+  if((b = bscan(dev, goal, sb.size)) == 0 &&
+     (b = bscan(dev, agroup.start, goal)) == 0)
+    panic("balloc: out of blocks");
+  bzero(dev, b);
+  return b;
+}
+
+// Allocate a block for inode ip: right after the last one it
+// got, or for a new file, at its allocation group's cursor.
+static uint
+iballoc(struct inode *ip)
+{
+  uint goal, addr;
+  int g = ip->inum % NAGROUP;
+
+  acquire(&agroup.lock);
+  goal = ip->lastalloc ? ip->lastalloc + 1 : agroup.cursor[g];
+  release(&agroup.lock);
+
+  addr = balloc(ip->dev, goal);
+
+  acquire(&agroup.lock);
+  if(ip->lastalloc == 0)
+    agroup.cursor[g] = addr + 1;
+  release(&agroup.lock);
+  ip->lastalloc = addr;
+  return addr;
 }
 
 // Free a disk block.
@@ -187,7 +251,7 @@ iinit()
   }
 }
 
-static struct inode* iget(uint dev, uint inum);
+static void dhfree(struct inode*);
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -239,7 +303,7 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
@@ -297,6 +361,7 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
+    dhfree(ip);
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
@@ -306,6 +371,8 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->bmstart = 0;
+    ip->lastalloc = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -344,6 +411,8 @@ iput(struct inode *ip)
     release(&icache.lock);
 
     itrunc(ip);
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
@@ -371,18 +440,83 @@ iunlockput(struct inode *ip)
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
+//
+// A T_EXTENT inode (mkfs lays audio files out this way)
+// lists runs of consecutive blocks in ip->addrs[] instead,
+// so mapping a block needs no indirect block reads.
+
+// Return the disk block address of the nth block in T_EXTENT
+// inode ip. Appending a block extends the last extent if the
+// next disk block is free, or starts a new one. Returns 0 if
+// that needs more than NEXTENT extents.
+static uint
+emap(struct inode *ip, uint bn)
+{
+  uint addr, start, len;
+  int i;
+
+  start = len = 0;
+  for(i = 0; i < NEXTENT; i++){
+    start = ip->addrs[2*i];
+    len = ip->addrs[2*i+1];
+    if(len == 0)
+      break;
+    if(bn < len)
+      return start + bn;
+    bn -= len;
+  }
+  if(bn != 0)
+    panic("emap: hole");
+
+  if(i > 0)
+    ip->lastalloc = start + len - 1;
+  addr = iballoc(ip);
+  if(i > 0 && addr == start + len){
+    ip->addrs[2*(i-1)+1]++;
+    return addr;
+  }
+  if(i == NEXTENT){
+    bfree(ip->dev, addr);
+    return 0;
+  }
+  ip->addrs[2*i] = addr;
+  ip->addrs[2*i+1] = 1;
+  return addr;
+}
+
+// Remember the NBMAP entries of indirect block a around a[i],
+// which is the address of file block bn, in ip's bmap cache,
+// so that bmap() can skip reading a for the next few blocks
+// of a sequential read.
+static void
+bmfill(struct inode *ip, uint *a, uint i, uint bn)
+{
+  uint k = i - i % NBMAP;
+
+  ip->bmstart = bn - (i - k);
+  memmove(ip->bmaddrs, a + k, sizeof(ip->bmaddrs));
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
+// Returns 0 if a T_EXTENT inode can't grow.
 static uint
 bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
   struct buf *bp;
+  uint lbn = bn;
+
+  if(ip->type == T_EXTENT)
+    return emap(ip, bn);
+
+  if(ip->bmstart != 0 && bn >= ip->bmstart && bn < ip->bmstart + NBMAP &&
+     (addr = ip->bmaddrs[bn - ip->bmstart]) != 0)
+    return addr;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip);
     return addr;
   }
   bn -= NDIRECT;
@@ -390,13 +524,14 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = iballoc(ip);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = iballoc(ip);
       log_write(bp);
     }
+    bmfill(ip, a, bn, lbn);
     brelse(bp);
     return addr;
   }
@@ -408,11 +543,11 @@ bmap(struct inode *ip, uint bn)
     int idx = bn / NINDIRECT;
     int off = bn % NINDIRECT;
     if((addr = ip->addrs[NDIRECT + 1]) == 0)
-      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT + 1] = addr = iballoc(ip);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[idx]) == 0){
-      a[idx] = addr = balloc(ip->dev);
+      a[idx] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -420,9 +555,10 @@ bmap(struct inode *ip, uint bn)
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[off]) == 0){
-      a[off] = addr = balloc(ip->dev);
+      a[off] = addr = iballoc(ip);
       log_write(bp);
     }
+    bmfill(ip, a, off, lbn);
     brelse(bp);
     return addr;
   }
@@ -439,6 +575,20 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  if(ip->type == T_EXTENT){
+    for(i = 0; i < NEXTENT; i++){
+      for(j = 0; j < ip->addrs[2*i+1]; j++)
+        bfree(ip->dev, ip->addrs[2*i] + j);
+    }
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->lastalloc = 0;
+    // an empty file grows through the usual block map.
+    ip->type = T_FILE;
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -481,6 +631,9 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT + 1] = 0;
   }
 
+  ip->bmstart = 0;
+  ip->lastalloc = 0;
+  dhfree(ip);
   ip->size = 0;
   iupdate(ip);
 }
@@ -525,6 +678,76 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Read data from inode straight into user memory at dst,
+// bypassing the buffer cache, for O_DIRECT files. Whole
+// blocks that aren't cached are read by DMA into the user's
+// pages, up to DIRECTRUN blocks per disk request when they
+// are consecutive on disk. Partial blocks, and blocks the cache
+// holds (it may have newer data than the disk), go through
+// readi(). The process is asleep in this call, so its pages
+// stay mapped. Caller must hold ip->lock.
+int
+readdirect(struct inode *ip, uint64 dst, uint off, uint n)
+{
+  pagetable_t pagetable = myproc()->pagetable;
+  uint64 addrs[DIRECTSEG], va, pa;
+  uint lens[DIRECTSEG], tot, m, addr, a;
+  int nseg, nblk;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(m < BSIZE || bcached(ip->dev, (addr = bmap(ip, off/BSIZE)))){
+      if(readi(ip, 1, dst, off, m) != m)
+        return -1;
+      continue;
+    }
+
+    // gather a run of whole, uncached, consecutive blocks.
+    for(nblk = 1; nblk < DIRECTRUN && n - tot >= (nblk+1)*BSIZE; nblk++){
+      a = bmap(ip, off/BSIZE + nblk);
+      if(a != addr + nblk || bcached(ip->dev, a))
+        break;
+    }
+    m = nblk * BSIZE;
+
+    // find the physical pages of dst..dst+m.
+    nseg = 0;
+    for(va = dst; va < dst + m; va = PGROUNDDOWN(va) + PGSIZE){
+      if((pa = walkaddr(pagetable, PGROUNDDOWN(va))) == 0)
+        return -1;
+      addrs[nseg] = pa + (va - PGROUNDDOWN(va));
+      lens[nseg] = min(dst + m - va, PGSIZE - (va - PGROUNDDOWN(va)));
+      nseg++;
+    }
+    virtio_disk_read_direct(addr, addrs, lens, nseg);
+  }
+  return tot;
+}
+
+// Start reading nblk blocks of ip from block bn into the
+// buffer cache in the background, stopping at the end of
+// the file. Caller must hold ip->lock.
+void
+readahead(struct inode *ip, uint bn, uint nblk)
+{
+  uint end, addrs[NPREFETCH];
+  int n;
+
+  end = (ip->size + BSIZE - 1) / BSIZE;
+  if(bn + nblk < end)
+    end = bn + nblk;
+  while(bn < end){
+    for(n = 0; n < NELEM(addrs) && bn < end; n++, bn++)
+      addrs[n] = bmap(ip, bn);
+    bprefetch(ip->dev, addrs, n);
+  }
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -544,7 +767,10 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    uint addr = bmap(ip, off/BSIZE);
+    if(addr == 0)
+      break;
+    bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
@@ -573,17 +799,127 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// A directory with at least DHMIN entries gets an in-memory
+// hash index from names to dirent offsets, built by its first
+// dirlookup(), so that lookups don't scan the whole directory.
+// It's an open-addressed table of offsets; dirlink() and
+// dirunlink() keep it up to date, and it goes away when the
+// inode is freed or leaves the inode cache. The dirents
+// themselves are read from the buffer cache as usual.
+#define DHMIN   64          // smallest directory to index
+#define DHDEL   0xffffffff  // slot of a removed entry
+
+struct dirhash {
+  uint nslot;    // size of slot[], a power of two
+  uint nused;    // slots that aren't empty, including DHDEL
+  uint freeoff;  // no empty dirent before this offset
+  uint slot[];   // dirent offset + 1, or 0 if empty, or DHDEL
+};
+
+static uint
+namehash(char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+static void
+dhfree(struct inode *dp)
+{
+  if(dp->dh){
+    kmfree(dp->dh);
+    dp->dh = 0;
+  }
+}
+
+// Add the dirent at off to the index. If the table is getting
+// full, drop it instead; the next dirlookup() builds a bigger one.
+static void
+dhinsert(struct inode *dp, char *name, uint off)
+{
+  struct dirhash *dh = dp->dh;
+  uint i;
+
+  if((dh->nused + 1) * 2 > dh->nslot){
+    dhfree(dp);
+    return;
+  }
+  for(i = namehash(name); dh->slot[i & (dh->nslot-1)] != 0; i++)
+    ;
+  dh->slot[i & (dh->nslot-1)] = off + 1;
+  dh->nused++;
+}
+
+// Build dp's index, reading the directory a block at a time.
+static void
+dhbuild(struct inode *dp)
+{
+  struct dirhash *dh;
+  struct dirent *de;
+  struct buf *bp;
+  uint n, nslot, off;
+
+  n = dp->size / sizeof(struct dirent);
+  for(nslot = 2*DHMIN; nslot < 4*n; nslot *= 2)
+    ;
+  if((dh = kmalloc(sizeof(*dh) + nslot*sizeof(uint))) == 0)
+    return;  // scan instead
+  memset(dh, 0, sizeof(*dh) + nslot*sizeof(uint));
+  dh->nslot = nslot;
+  dh->freeoff = dp->size;
+  dp->dh = dh;
+
+  for(off = 0; off < dp->size; off += BSIZE){
+    bp = bread(dp->dev, bmap(dp, off/BSIZE));
+    for(de = (struct dirent*)bp->data;
+        de < (struct dirent*)(bp->data + min(BSIZE, dp->size - off)); de++){
+      n = off + ((char*)de - (char*)bp->data);
+      if(de->inum == 0){
+        if(n < dh->freeoff)
+          dh->freeoff = n;
+        continue;
+      }
+      dhinsert(dp, de->name, n);
+    }
+    brelse(bp);
+  }
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, inum, i, s;
   struct dirent de;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dp->dh == 0 && dp->size >= DHMIN*sizeof(de))
+    dhbuild(dp);
+
+  if(dp->dh){
+    struct dirhash *dh = dp->dh;
+    for(i = namehash(name); (s = dh->slot[i & (dh->nslot-1)]) != 0; i++){
+      if(s == DHDEL)
+        continue;
+      off = s - 1;
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlookup read");
+      if(de.inum != 0 && namecmp(name, de.name) == 0){
+        if(poff)
+          *poff = off;
+        return iget(dp->dev, de.inum);
+      }
+    }
+    return 0;
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -616,7 +952,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  for(off = dp->dh ? dp->dh->freeoff : 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlink read");
     if(de.inum == 0)
@@ -627,10 +963,41 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcinval(dp->dev, dp->inum, name);
 
+  if(dp->dh){
+    dp->dh->freeoff = off + sizeof(de);
+    dhinsert(dp, de.name, off);
+  }
   return 0;
 }
 
+// Clear the directory entry at offset off in dp.
+void
+dirunlink(struct inode *dp, uint off)
+{
+  struct dirhash *dh = dp->dh;
+  struct dirent de;
+  uint i;
+
+  if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink read");
+  if(dh){
+    for(i = namehash(de.name); dh->slot[i & (dh->nslot-1)] != off + 1; i++)
+      if(dh->slot[i & (dh->nslot-1)] == 0)
+        panic("dirunlink: not indexed");
+    dh->slot[i & (dh->nslot-1)] = DHDEL;
+    if(off < dh->freeoff)
+      dh->freeoff = off;
+  }
+
+  dcinval(dp->dev, dp->inum, de.name);
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -685,6 +1052,15 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    // names in the cache skip locking and scanning ip.
+    if(!(nameiparent && *path == '\0') &&
+       dclookup(ip->dev, ip->inum, name, &next)){
+      iput(ip);
+      if(next == 0)
+        return 0;
+      ip = next;
+      continue;
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -696,9 +1072,11 @@ namex(char *path, int nameiparent, char *name)
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
+      dcenter(ip->dev, ip->inum, name, 0);
       iunlockput(ip);
       return 0;
     }
+    dcenter(ip->dev, ip->inum, name, next->inum);
     iunlockput(ip);
     ip = next;
   }
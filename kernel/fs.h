@@ -28,6 +28,11 @@ struct superblock {
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT)
 
+// A T_EXTENT inode's addrs[] instead holds up to NEXTENT
+// (start block, length) pairs, covering the file in order.
+// A zero length ends the list.
+#define NEXTENT ((NDIRECT+2) / 2)
+
 // On-disk inode structure
 struct dinode {
   short type;           // File type
@@ -58,3 +63,13 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entry as returned by getdents(), with
+// the type and size of the inode it names.
+struct dirinfo {
+  uint inum;
+  short type;
+  short nlink;
+  uint size;
+  char name[DIRSIZ+1];  // NUL-terminated
+};
+
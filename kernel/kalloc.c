@@ -1,6 +1,25 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and slab pages. Allocates whole 4096-byte pages.
+// Memory from BUDDYSTART up belongs to buddy.c instead.
+//
+// Each CPU keeps its own free list, so kalloc() and kfree()
+// normally take only that CPU's (uncontended) lock. Pages
+// move between the per-CPU lists and a global pool KBATCH at
+// a time; a CPU whose list and the pool are both empty steals
+// half of another CPU's list.
+//
+// Idle CPUs zero free pages ahead of time into the kzero pool,
+// so kzalloc() can usually hand out a zeroed page without
+// paying for the memset.
+//
+// Each allocated page has a reference count, which kalloc()
+// sets to 1 and kref() raises; kfree() drops it, and frees the
+// page when it reaches 0. Shared memory (see shm.c) maps the
+// same page into several page tables this way.
+//
+// Pages are filled with junk on kfree() and kalloc() to catch
+// dangling references, except in a RELEASE build.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +28,9 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define KBATCH 32  // pages moved to or from the global pool at once
+#define NZPAGE 256 // pre-zeroed pages for kzalloc() to keep ready
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -18,16 +40,29 @@ struct run {
   struct run *next;
 };
 
-struct {
+struct freelist {
   struct spinlock lock;
-  struct run *freelist;
-} kmem;
+  struct run *head;
+  int n;             // number of pages on the list
+  uint steals;       // batches stolen from other CPUs' lists
+};
+
+struct freelist kmem;        // global pool
+struct freelist kcpu[NCPU];  // per-CPU free lists
+struct freelist kzero;       // zeroed pages, for kzalloc()
+
+// reference counts of the pages kalloc() manages; 0 when free.
+int pageref[(BUDDYSTART - KERNBASE) / PGSIZE];
+#define PAGEREF(pa) (&pageref[((uint64)(pa) - KERNBASE) / PGSIZE])
 
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcpu[i].lock, "kmem_cpu");
+  initlock(&kzero.lock, "kzero");
+  freerange(end, (void*)BUDDYSTART);
 }
 
 void
@@ -35,31 +70,91 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    *PAGEREF(p) = 1;
     kfree(p);
+  }
+}
+
+// Detach up to max pages from the front of fl.
+// Returns the chain, and sets *np to its length.
+static struct run*
+takebatch(struct freelist *fl, int max, int *np)
+{
+  struct run *head, *r;
+  int n;
+
+  acquire(&fl->lock);
+  head = r = fl->head;
+  n = 0;
+  if(r){
+    for(n = 1; n < max && r->next; n++)
+      r = r->next;
+    fl->head = r->next;
+    r->next = 0;
+    fl->n -= n;
+  }
+  release(&fl->lock);
+  *np = n;
+  return head;
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Prepend the n-page chain head..tail to fl.
+static void
+putbatch(struct freelist *fl, struct run *head, struct run *tail, int n)
+{
+  acquire(&fl->lock);
+  tail->next = fl->head;
+  fl->head = head;
+  fl->n += n;
+  release(&fl->lock);
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last.
+// (The exception is when initializing the allocator;
+// see kinit above.)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *head, *tail;
+  struct freelist *c;
+  int n;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= BUDDYSTART)
     panic("kfree");
+  if((n = __sync_sub_and_fetch(PAGEREF(pa), 1)) > 0)
+    return;
+  if(n < 0)
+    panic("kfree: free page");
 
+#ifndef RELEASE
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcpu[cpuid()];
+  head = tail = 0;
+  acquire(&c->lock);
+  r->next = c->head;
+  c->head = r;
+  c->n++;
+  if(c->n > 2*KBATCH){
+    // give a batch back to the global pool.
+    head = tail = c->head;
+    for(n = 1; n < KBATCH; n++)
+      tail = tail->next;
+    c->head = tail->next;
+    c->n -= KBATCH;
+  }
+  release(&c->lock);
+  if(head)
+    putbatch(&kmem, head, tail, KBATCH);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +163,118 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct run *r, *tail;
+  struct freelist *c;
+  int id, i, n;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  c = &kcpu[id];
+
+  acquire(&c->lock);
+  r = c->head;
+  if(r){
+    c->head = r->next;
+    c->n--;
+  }
+  release(&c->lock);
 
+  if(r == 0){
+    // refill from the global pool, or else steal half of
+    // another CPU's list. only one lock is held at a time.
+    r = takebatch(&kmem, KBATCH, &n);
+    for(i = 1; r == 0 && i < NCPU; i++){
+      struct freelist *o = &kcpu[(id + i) % NCPU];
+      if(o->n > 0)
+        r = takebatch(o, (o->n + 1) / 2, &n);
+      if(r)
+        c->steals++;
+    }
+    if(r == 0)
+      r = takebatch(&kzero, 1, &n);
+    if(r && r->next){
+      for(tail = r->next; tail->next; tail = tail->next)
+        ;
+      putbatch(c, r->next, tail, n - 1);
+    }
+  }
+  pop_off();
+
+  if(r)
+    *PAGEREF(r) = 1;
+#ifndef RELEASE
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// Add a reference to an allocated page, which will take
+// one more kfree() to free.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= BUDDYSTART)
+    panic("kref");
+  if(__sync_fetch_and_add(PAGEREF(pa), 1) <= 0)
+    panic("kref: free page");
+}
+
+// Allocate one zeroed page, preferably one that an idle
+// CPU already zeroed. Returns 0 if out of memory.
+void *
+kzalloc(void)
+{
+  struct run *r;
+  int n;
+
+  r = 0;
+  if(kzero.n > 0)
+    r = takebatch(&kzero, 1, &n);
+  if(r){
+    r->next = 0;
+    *PAGEREF(r) = 1;
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
   return (void*)r;
 }
+
+// Zero one free page into the kzero pool, if it isn't full.
+// Called by the scheduler when it has nothing to run.
+// Returns 1 if it did any work.
+int
+kzeroidle(void)
+{
+  struct run *r;
+
+  if(kzero.n >= NZPAGE)
+    return 0;
+  if((r = kalloc()) == 0)
+    return 0;
+  memset((char*)r, 0, PGSIZE);
+  *PAGEREF(r) = 0;
+  putbatch(&kzero, r, r, 1);
+  return 1;
+}
+
+// Print free-list sizes and lock contention.
+// Runs when user types ^T on console.
+void
+kallocstats(void)
+{
+  uint n = kmem.lock.n, nts = kmem.lock.nts, steals = 0;
+  int nfree = kmem.n;
+
+  for(int i = 0; i < NCPU; i++){
+    n += kcpu[i].lock.n;
+    nts += kcpu[i].lock.nts;
+    steals += kcpu[i].steals;
+    nfree += kcpu[i].n;
+  }
+  printf("kalloc: %d free pages (%d in pool, %d zeroed), %d steals\n",
+         nfree + kzero.n, kmem.n, kzero.n, steals);
+  printf("kalloc: lock acquires %d, contended spins %d (pool %d)\n",
+         n, nts, kmem.lock.nts);
+}
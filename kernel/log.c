@@ -19,7 +19,20 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until logd makes room.
+//
+// Commits are done by a kernel thread, logd (group commit).
+// When the last outstanding end_op() finishes, it wakes logd
+// and waits only until the transaction is durable, i.e. until
+// the header is written. The log writes and the install
+// writes each go to the disk in batches.
+//
+// Installing is delayed (checkpointing): committed
+// transactions stay in the log, their blocks pinned in the
+// cache, until the log or the pinned buffers run short, or
+// the file system has been idle for LOGIDLE ticks. Each
+// block is then installed once, however many transactions
+// changed it in the meantime.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +41,9 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A block may appear more than once, for successive
+// transactions; recovery installs the last copy.
+// Log appends are synchronous with respect to logd.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -42,14 +57,32 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // in commit() or checkpoint(), please wait.
   int dev;
+  uint seq;        // number of the transaction being built
+  uint durable;    // transactions up to this one are on disk
+  int committed;   // lh.block[0..committed) are committed
+  int npinned;     // distinct blocks pinned in the cache
+  int wantspace;   // begin_op() is waiting for a checkpoint
+  uint lastcommit; // ticks at the last commit
   struct logheader lh;
+
+  // statistics
+  uint ncommit;
+  uint ncheckpoint;
+  uint ninstall;   // blocks written home
+  uint nabsorb;    // writes absorbed into an earlier log slot
 };
 struct log log;
 
+#define LOGBATCH 16  // blocks written to the disk at a time
+#define LOGIDLE  10  // checkpoint after this many idle ticks
+#define MAXPINNED (NBUF - 2*NPREFETCH)  // leave some buffers unpinned
+
 static void recover_from_log(void);
 static void commit();
+static void checkpoint();
+static void logd(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -61,24 +94,57 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.seq = 1;
   recover_from_log();
+  kthread(logd, "logd");
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// Only the last copy of each block in the log is installed.
+// Outside recovery the cache still holds (pinned) every
+// logged block with the committed contents, so there's no
+// need to read the log back: just write the cached blocks,
+// LOGBATCH at a time.
 static void
 install_trans(int recovering)
 {
-  int tail;
+  struct buf *dbufs[LOGBATCH];
+  int tail, i, j, n;
 
+  n = 0;
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+    for (j = tail+1; j < log.lh.n; j++)
+      if (log.lh.block[j] == log.lh.block[tail])
+        break;
+    if (j < log.lh.n)
+      continue;  // a later copy supersedes this one
+    if(recovering){
+      struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
+      dbufs[n] = bgetnew(log.dev, log.lh.block[tail]);
+      memmove(dbufs[n]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    } else {
+      dbufs[n] = bread(log.dev, log.lh.block[tail]);
+    }
+    if (++n == LOGBATCH || tail == log.lh.n - 1) {
+      bwritemany(dbufs, n);  // write dst to disk
+      for (i = 0; i < n; i++) {
+        if(recovering == 0)
+          bunpin(dbufs[i]);
+        brelse(dbufs[i]);
+      }
+      log.ninstall += n;
+      n = 0;
+    }
+  }
+  if (n > 0) {
+    bwritemany(dbufs, n);
+    for (i = 0; i < n; i++) {
+      if(recovering == 0)
+        bunpin(dbufs[i]);
+      brelse(dbufs[i]);
+    }
+    log.ninstall += n;
   }
 }
 
@@ -130,8 +196,12 @@ begin_op(void)
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE ||
+              log.npinned + (log.outstanding+1)*MAXOPBLOCKS > MAXPINNED){
+      // this op might exhaust log space or the buffer cache;
+      // wait for a checkpoint.
+      log.wantspace = 1;
+      wakeup(&log.outstanding);  // logd
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
@@ -142,64 +212,133 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// if the transaction has changes, waits until logd has
+// committed them to the on-disk log.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  uint seq;
 
   acquire(&log.lock);
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+    wakeup(&log.outstanding);  // logd
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
+  if(log.lh.n > log.committed){
+    seq = log.seq;
+    while(log.durable < seq)
+      sleep(&log.durable, &log.lock);
+  }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// The log daemon: commit each transaction once it has no
+// outstanding FS system calls, and checkpoint when the log
+// runs short or goes idle. Runs as a kernel thread.
+static void
+logd(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    if(log.outstanding > 0){
+      sleep(&log.outstanding, &log.lock);
+    } else if(log.lh.n > log.committed){
+      log.committing = 1;
+      release(&log.lock);
+      commit();
+      acquire(&log.lock);
+      log.committing = 0;
+      wakeup(&log);
+    } else if(log.committed > 0 &&
+              (log.wantspace || ticks - log.lastcommit >= LOGIDLE)){
+      log.committing = 1;
+      release(&log.lock);
+      checkpoint();
+      acquire(&log.lock);
+      log.committing = 0;
+      log.wantspace = 0;
+      wakeup(&log);
+    } else {
+      // end_op(), begin_op() and logtick() wake us.
+      sleep(&log.outstanding, &log.lock);
+    }
   }
 }
 
-// Copy modified blocks from cache to log.
+// Called on every clock tick. If committed blocks are waiting
+// to be installed, wake logd, so it can checkpoint once the
+// file system has been idle for a while.
+void
+logtick(void)
+{
+  if(log.committed > 0)
+    wakeup(&log.outstanding);
+}
+
+// Copy the current transaction's blocks from cache to log,
+// LOGBATCH at a time. The log blocks are consecutive on disk,
+// so each batch goes to the disk as a single request.
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *to[LOGBATCH];
+  int tail, i, n;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = log.committed; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      to[i] = bgetnew(log.dev, log.start+tail+i+1); // log block
+      struct buf *from = bread(log.dev, log.lh.block[tail+i]); // cache block
+      memmove(to[i]->data, from->data, BSIZE);
+      brelse(from);
+    }
+    bwritemany(to, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
   }
 }
 
+// Append the current transaction to the on-disk log, and
+// leave it there for checkpoint() to install.
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
-  }
+  write_log();     // Write modified blocks from cache to log
+  write_head();    // Write header to disk -- the real commit
+
+  // the transaction is durable; let its system calls return.
+  acquire(&log.lock);
+  log.committed = log.lh.n;
+  log.durable = log.seq++;
+  log.lastcommit = ticks;
+  log.ncommit++;
+  wakeup(&log.durable);
+  release(&log.lock);
+}
+
+// Install all committed transactions and empty the log.
+// There must be no uncommitted changes in the cache.
+static void
+checkpoint()
+{
+  install_trans(0); // Now install writes to home locations
+  log.lh.n = 0;
+  write_head();    // Erase the transactions from the log
+
+  acquire(&log.lock);
+  log.committed = 0;
+  log.npinned = 0;
+  log.ncheckpoint++;
+  release(&log.lock);
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -222,15 +361,30 @@ log_write(struct buf *b)
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
+  // find the block's latest slot, if it is in the log.
+  for (i = log.lh.n - 1; i >= 0; i--) {
+    if (log.lh.block[i] == b->blockno)
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
-    bpin(b);
-    log.lh.n++;
+  if (i >= log.committed) {  // log absorption
+    log.nabsorb++;
+  } else {
+    // a block only in committed slots is pinned already, but
+    // needs a new slot: the committed copy must stay intact.
+    if (i < 0) {
+      bpin(b);
+      log.npinned++;
+    }
+    log.lh.block[log.lh.n++] = b->blockno;
   }
   release(&log.lock);
 }
 
+// Print commit and checkpoint counts.
+// Runs when user types ^T on console.
+void
+logstats(void)
+{
+  printf("log: %d commits, %d checkpoints, %d blocks installed, %d writes absorbed\n",
+         log.ncommit, log.ncheckpoint, log.ninstall, log.nabsorb);
+}
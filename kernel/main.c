@@ -17,16 +17,21 @@ main()
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    bdinit();        // contiguous multi-page allocator
+    slabinit();      // small-object allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
     trapinit();      // trap vectors
+    hrtinit();       // kernel timeouts
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    dcinit();        // name cache
     fileinit();      // file table
+    shminit();       // shared memory segments
     virtio_disk_init(); // emulated hard disk
     // pci_init();      // init pci for sound card
     soundinit();     // init sound card
@@ -15,6 +15,7 @@
 // the kernel uses physical memory thus:
 // 80000000 -- entry.S, then kernel text and data
 // end -- start of kernel page allocation area
+// BUDDYSTART -- start of buddy allocator area (contiguous blocks)
 // PHYSTOP -- end RAM used by the kernel
 
 // qemu puts UART registers here in physical memory.
@@ -29,6 +30,7 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // software interrupt
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
@@ -49,6 +51,10 @@
 #define KERNBASE 0x80000000L
 #define PHYSTOP (KERNBASE + 128*1024*1024)
 
+// the top of RAM belongs to the buddy allocator (buddy.c),
+// for physically contiguous multi-page regions.
+#define BUDDYSTART (PHYSTOP - 8*1024*1024)
+
 // map the trampoline page to the highest address,
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
@@ -64,7 +70,10 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   trapframes of threads made by clone()
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define THREADFRAME(i) (TRAPFRAME - (uint64)(i)*PGSIZE)
+#define USERTOP THREADFRAME(NTHREAD-1)
 #define STACKTOP (KERNBASE - 4)
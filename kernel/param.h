@@ -1,13 +1,15 @@
 #define NPROC        64  // maximum number of processes
+#define NTHREAD       8  // maximum threads sharing a page table
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  100  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      (MAXOPBLOCKS*6)  // max data blocks in on-disk log
+#define NPREFETCH    16  // max blocks per read-ahead batch
+#define NBUF         (MAXOPBLOCKS*3+2*NPREFETCH)  // size of disk block cache
 #define FSSIZE       20000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKINTERVAL 1000000  // timer cycles per tick; about 1/10th second in qemu
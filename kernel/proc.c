@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "futex.h"
 
 struct cpu cpus[NCPU];
 
@@ -17,6 +18,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,6 +28,34 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Sleeping processes are kept in wait queues, hashed by
+// channel, so that wakeup() looks only at processes that
+// might be sleeping on its channel. A process is in the queue
+// from when it goes to sleep until it has woken up and taken
+// itself out again; the queue's lock is taken before any
+// p->lock.
+#define NWAITQ 61
+#define WAITQ(chan) (&waitq[((uint64)(chan) >> 3) % NWAITQ])
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;  // through proc.wqnext
+} waitq[NWAITQ];
+
+// Threads made by clone() share the page table, and so the
+// memory, of the process that made them. Each has a trapframe
+// of its own, in one of the NTHREAD pages from TRAPFRAME down
+// (see THREADFRAME), and the group's lock serializes changes
+// to the shared page table. The last thread to be freed frees
+// the page table.
+struct tgroup tgroups[NPROC];
+
+// makes futex()'s test of the user's word atomic
+// with respect to FUTEX_WAKE.
+struct spinlock futex_lock;
+
+#define TFSLOT(va) ((TRAPFRAME - (va)) / PGSIZE)
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -54,6 +84,13 @@ procinit(void)
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
   }
+  for(int i = 0; i < NCPU; i++)
+    initlock(&cpus[i].rqlock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
+  for(int i = 0; i < NPROC; i++)
+    initlock(&tgroups[i].lock, "tgroup");
+  initlock(&futex_lock, "futex");
 }
 
 // Must be called with interrupts disabled,
@@ -119,6 +156,8 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->cpu = cpuid();
+  p->tfva = TRAPFRAME;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -154,7 +193,7 @@ freeproc(struct proc *p)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
   if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+    proc_freeuser(p, p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
@@ -163,6 +202,7 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->rt = 0;
   p->state = UNUSED;
 }
 
@@ -209,6 +249,31 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
   uvmfree(pagetable, sz);
 }
 
+// Free p's user memory and page table, or, if other threads
+// still share them, just p's trapframe mapping. pagetable
+// and sz are p's, or its old ones if exec() is replacing them.
+void
+proc_freeuser(struct proc *p, pagetable_t pagetable, uint64 sz)
+{
+  struct tgroup *tg = p->tg;
+  int last;
+
+  if(tg == 0){
+    proc_freepagetable(pagetable, sz);
+    return;
+  }
+  acquire(&tg->lock);
+  uvmunmap(pagetable, p->tfva, 1, 0);
+  tg->slots &= ~(1 << TFSLOT(p->tfva));
+  last = --tg->nthread == 0;
+  p->tg = 0;
+  release(&tg->lock);
+  if(last){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, sz);
+  }
+}
+
 // a user program that calls exec("/init")
 // od -t xC initcode
 uchar initcode[] = {
@@ -242,29 +307,107 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growing only reserves address space; usertrap()
+// allocates each page the first time it's touched.
 // Return 0 on success, -1 on failure.
+// The threads of a process share its size. Shrinking with
+// other threads about isn't allowed, since their CPUs' TLBs
+// might still hold the freed pages.
 int
 growproc(int n)
 {
-  uint sz;
-  struct proc *p = myproc();
+  uint64 sz;
+  struct proc *p = myproc(), *q;
+  struct tgroup *tg = p->tg;
 
+  if(tg)
+    acquire(&tg->lock);
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
-      return -1;
-    }
+    if(sz + n >= USERTOP)
+      goto bad;
+    sz += n;
   } else if(n < 0){
+    if(tg && tg->nthread > 1)
+      goto bad;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
+  if(tg){
+    for(q = proc; q < &proc[NPROC]; q++)
+      if(q->tg == tg)
+        q->sz = sz;
+    release(&tg->lock);
+  }
   return 0;
+
+bad:
+  if(tg)
+    release(&tg->lock);
+  return -1;
+}
+
+// Map the npages physical pages pa[] at the top of the
+// caller's memory, as shared memory (see shm.c), and grow
+// the memory to cover them. Takes over a reference to each
+// page. Returns the address of the first, or -1.
+uint64
+growshared(uint64 *pa, int npages)
+{
+  struct proc *p = myproc(), *q;
+  struct tgroup *tg = p->tg;
+  uint64 va, sz;
+  int i = 0;
+
+  if(tg)
+    acquire(&tg->lock);
+  va = PGROUNDUP(p->sz);
+  sz = va + (uint64)npages*PGSIZE;
+  if(sz >= USERTOP)
+    goto bad;
+  for(i = 0; i < npages; i++)
+    if(mappages(p->pagetable, va + i*PGSIZE, PGSIZE, pa[i],
+                PTE_R | PTE_W | PTE_U | PTE_SHM) != 0)
+      goto bad;
+  p->sz = sz;
+  if(tg){
+    for(q = proc; q < &proc[NPROC]; q++)
+      if(q->tg == tg)
+        q->sz = sz;
+    release(&tg->lock);
+  }
+  return va;
+
+bad:
+  if(i > 0)
+    uvmunmap(p->pagetable, va, i, 1);
+  for(; i < npages; i++)
+    kfree((void*)pa[i]);
+  if(tg)
+    release(&tg->lock);
+  return -1;
+}
+
+// Allocate the page for the lazily-allocated heap address
+// va of p; see uvmlazy(). Threads sharing the page table
+// might fault on the same page at once.
+int
+proclazy(struct proc *p, uint64 va)
+{
+  int r;
+
+  if(p->tg == 0)
+    return uvmlazy(p->pagetable, va, p->sz);
+  acquire(&p->tg->lock);
+  r = uvmlazy(p->pagetable, va, p->sz);
+  release(&p->tg->lock);
+  return r;
 }
 
 // Create a new process, copying the parent.
@@ -312,7 +455,140 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Find p a thread group, making one with just p in it if
+// p isn't in one yet, and return it locked. Returns 0 if
+// there are none to spare.
+static struct tgroup*
+tglock(struct proc *p)
+{
+  struct tgroup *tg;
+
+  if(p->tg){
+    acquire(&p->tg->lock);
+    return p->tg;
+  }
+  for(tg = tgroups; tg < &tgroups[NPROC]; tg++){
+    acquire(&tg->lock);
+    if(tg->nthread == 0){
+      tg->nthread = 1;
+      tg->execing = 0;
+      tg->slots = 1 << TFSLOT(p->tfva);
+      p->tg = tg;
+      return tg;
+    }
+    release(&tg->lock);
+  }
+  return 0;
+}
+
+// Called by exec() before it replaces p's memory, which it
+// may do only if no other thread shares it. Until exec()
+// succeeds, and takes p out of its group, or tgexecfail()
+// says it failed, clone() refuses to add threads.
+// Returns -1 if there are other threads.
+int
+tgexecstart(struct proc *p)
+{
+  struct tgroup *tg = p->tg;
+
+  if(tg == 0)
+    return 0;
+  acquire(&tg->lock);
+  if(tg->nthread > 1){
+    release(&tg->lock);
+    return -1;
+  }
+  tg->execing = 1;
+  release(&tg->lock);
+  return 0;
+}
+
+void
+tgexecfail(struct proc *p)
+{
+  struct tgroup *tg = p->tg;
+
+  if(tg == 0)
+    return;
+  acquire(&tg->lock);
+  tg->execing = 0;
+  release(&tg->lock);
+}
+
+// Create a thread: a new process that shares the caller's
+// page table, and so its memory, and starts at fn(arg) on
+// the given stack, with a trapframe and kernel stack of its
+// own. Otherwise it is a child like fork()'s, with copies of
+// the open files, collected by wait(). fn must not return;
+// it ends with exit().
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, slot, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct tgroup *tg;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  // allocproc() made np a page table of its own; use p's.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = 0;
+
+  if((tg = tglock(p)) == 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  for(slot = 0; slot < NTHREAD; slot++)
+    if((tg->slots & (1 << slot)) == 0)
+      break;
+  if(tg->execing || slot == NTHREAD ||
+     mappages(p->pagetable, THREADFRAME(slot), PGSIZE,
+              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    release(&tg->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  tg->slots |= 1 << slot;
+  tg->nthread++;
+  np->tg = tg;
+  np->tfva = THREADFRAME(slot);
+  np->pagetable = p->pagetable;
+  np->sz = p->sz;
+  release(&tg->lock);
+
+  // start at fn(arg), on the new stack.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  np->rt = p->rt;
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -427,6 +703,124 @@ wait(uint64 addr)
   }
 }
 
+// Each CPU has a queue of RUNNABLE processes. A process
+// goes on the queue of the CPU it last ran on, unless that
+// CPU is busy and another is idle, and an idle CPU that finds
+// its own queue empty takes work from the others'. A CPU with
+// nothing to do waits for an interrupt, and a CPU that puts a
+// process on an idle CPU's queue wakes it with an IPI.
+//
+// Real-time processes (see setrt()) have queues of their own,
+// which come first, and they aren't preempted by the timer;
+// they run until they sleep, like SCHED_FIFO. A real-time
+// process that wakes up is sent to a CPU that is idle or
+// running an ordinary process, and an IPI makes that CPU
+// yield to it at once.
+
+// Append p to c's run queue. Caller must hold p->lock.
+static void
+rqpush(struct cpu *c, struct proc *p)
+{
+  struct proc *cp;
+
+  acquire(&c->rqlock);
+  p->rqnext = 0;
+  if(c->rqtail[p->rt])
+    c->rqtail[p->rt]->rqnext = p;
+  else
+    c->rqhead[p->rt] = p;
+  c->rqtail[p->rt] = p;
+  release(&c->rqlock);
+  cp = c->proc;
+  // an IPI to this CPU takes effect when interrupts are
+  // next enabled; preempt tells devintr() to yield.
+  if(p->rt && cp && !cp->rt)
+    c->preempt = 1;
+  if(c->idle || (p->rt && cp && !cp->rt))
+    ipi(c - cpus);
+}
+
+// Take the first process off c's run queue for class rt, or
+// return 0. The process is RUNNABLE but in no queue, so no one
+// else will touch it until the caller locks it and runs it.
+static struct proc*
+rqpop(struct cpu *c, int rt)
+{
+  struct proc *p;
+
+  if(c->rqhead[rt] == 0)  // don't bother taking the lock
+    return 0;
+  acquire(&c->rqlock);
+  if((p = c->rqhead[rt]) != 0){
+    c->rqhead[rt] = p->rqnext;
+    if(c->rqhead[rt] == 0)
+      c->rqtail[rt] = 0;
+  }
+  release(&c->rqlock);
+  return p;
+}
+
+// Choose the next process for c to run: real-time ones
+// first, from c's queue, then from other CPUs' queues.
+static struct proc*
+rqnext(struct cpu *c)
+{
+  struct proc *p;
+  int i, rt;
+
+  for(rt = 1; rt >= 0; rt--){
+    if((p = rqpop(c, rt)) != 0)
+      return p;
+    for(i = 1; i < NCPU; i++){
+      if((p = rqpop(&cpus[(c - cpus + i) % NCPU], rt)) != 0){
+        c->nsteal++;
+        return p;
+      }
+    }
+  }
+  return 0;
+}
+
+static int
+anyrunnable(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    if(cpus[i].rqhead[0] || cpus[i].rqhead[1])
+      return 1;
+  return 0;
+}
+
+// Make p RUNNABLE and queue it, preferably on the CPU it
+// last ran on. Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct cpu *c = &cpus[p->cpu];
+  struct proc *cp;
+  int i;
+
+  p->state = RUNNABLE;
+  p->wakets = r_time();
+  if(!c->idle){
+    for(i = 0; i < NCPU; i++){
+      if(cpus[i].idle){
+        c = &cpus[i];
+        break;
+      }
+    }
+  }
+  if(p->rt && !c->idle && (cp = c->proc) != 0 && cp->rt){
+    // find a CPU running an ordinary process to preempt.
+    for(i = 0; i < NCPU; i++){
+      if((cp = cpus[i].proc) != 0 && !cp->rt){
+        c = &cpus[i];
+        break;
+      }
+    }
+  }
+  rqpush(c, p);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -439,28 +833,60 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int idled = 0;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    if((p = rqnext(c)) == 0){
+      // Nothing to run; make zeroed pages for kzalloc(),
+      // or else wait for an interrupt. Interrupts are off
+      // so that one can't slip in between the check and
+      // the wfi; wfi wakes up for it anyway.
+      if(kzeroidle())
+        continue;
+      intr_off();
+      timerset();  // no ticks while idle, except on hart 0
+      idled = 1;
+      c->idle = 1;
+      __sync_synchronize();
+      if(!anyrunnable()){
+        c->nidle++;
+        asm volatile("wfi");
       }
-      release(&p->lock);
+      c->idle = 0;
+      continue;
     }
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+    p->state = RUNNING;
+    p->cpu = c - cpus;
+    c->proc = p;
+    c->nswitch++;
+    if(idled || c->nexttick < r_time())
+      timerset();  // was idle; start ticking again
+    idled = 0;
+    if(p->wakets){
+      uint64 lat = r_time() - p->wakets;
+      c->nlat[p->rt]++;
+      c->latsum[p->rt] += lat;
+      if(lat > c->latmax[p->rt])
+        c->latmax[p->rt] = lat;
+      p->wakets = 0;
+    }
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -498,6 +924,8 @@ yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  p->wakets = 0;
+  rqpush(&cpus[p->cpu], p);
   sched();
   release(&p->lock);
 }
@@ -523,77 +951,191 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's first scheduling by scheduler()
+// will swtch to kthreadstart.
+static void
+kthreadstart(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  myproc()->kfn();
+  panic("kthread returned");
+}
+
+// Start a kernel thread that runs fn(), for kernel daemons
+// such as the log's committer. It has no parent and never
+// returns to user space; fn() must not return.
+void
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+  setrunnable(p);
+  release(&p->lock);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = WAITQ(chan);
+  struct proc **pp;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold the wait queue's lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks it),
   // so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = wq->head;
+  wq->head = p;
+  release(&wq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; *pp != p; pp = &(*pp)->wqnext)
+    ;
+  *pp = p->wqnext;
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
-// Wake up all processes sleeping on chan.
+// Wake up at most n processes sleeping on chan, or all
+// of them if n < 0. Returns how many were woken.
 // Must be called without any p->lock.
-void
-wakeup(void *chan)
+int
+wakeupn(void *chan, int n)
 {
+  struct waitq *wq = WAITQ(chan);
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  acquire(&wq->lock);
+  for(p = wq->head; p && woken != n; p = p->wqnext) {
+    // p->chan doesn't change while p is asleep in this queue.
+    if(p != myproc() && p->chan == chan){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        setrunnable(p);
+        woken++;
       }
       release(&p->lock);
     }
   }
+  release(&wq->lock);
+  return woken;
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakeupn(chan, -1);
+}
+
+// Block on, or wake those blocked on, the int at user address
+// uaddr. FUTEX_WAIT sleeps unless the int isn't val, and
+// FUTEX_WAKE wakes up to val sleepers (all, if val < 0) and
+// returns how many it woke. The channel is the int's physical address, which is
+// the same in every page table that maps it. A waker stores
+// to the int before its FUTEX_WAKE, so a waiter that sees the
+// old value holds futex_lock until it's asleep, in time to be
+// woken. Returns -1 if the int doesn't hold val, or if the
+// caller was killed while waiting.
+int
+futex(uint64 uaddr, int op, int val)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+  void *chan;
+  int r = -1;
+
+  if(uaddr % sizeof(int) != 0 ||
+     (pa = walkaddr(p->pagetable, PGROUNDDOWN(uaddr))) == 0)
+    return -1;
+  chan = (void*)(pa + uaddr % PGSIZE);
+
+  acquire(&futex_lock);
+  if(op == FUTEX_WAIT){
+    if(*(volatile int*)chan == val && !p->killed){
+      sleep(chan, &futex_lock);
+      r = p->killed ? -1 : 0;
+    }
+  } else if(op == FUTEX_WAKE){
+    r = wakeupn(chan, val);
+  }
+  release(&futex_lock);
+  return r;
 }
 
-// Kill the process with the given pid.
-// The victim won't exit until it tries to return
-// to user space (see usertrap() in trap.c).
+// Mark p killed, and wake it if it's asleep.
+// p->lock must be held.
+static void
+killlocked(struct proc *p)
+{
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
+  }
+}
+
+// Kill the process with the given pid, and any threads
+// sharing its memory (see clone()), which would otherwise
+// be left waiting for it. The victims won't exit until they
+// try to return to user space (see usertrap() in trap.c).
 int
 kill(int pid)
 {
   struct proc *p;
+  struct tgroup *tg;
 
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
+      killlocked(p);
+      tg = p->tg;
       release(&p->lock);
-      return 0;
+      goto found;
     }
     release(&p->lock);
   }
   return -1;
+
+found:
+  if(tg == 0)
+    return 0;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->tg == tg)
+      killlocked(p);
+    release(&p->lock);
+  }
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -626,6 +1168,46 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Make the current process real-time, or ordinary again.
+// Children don't inherit it.
+void
+setrt(int on)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  p->rt = on != 0;
+  release(&p->lock);
+}
+
+// Print how much each CPU has run, stolen and idled, and
+// wakeup-to-run latencies in microseconds.
+// Runs when user types ^T on console.
+void
+schedstats(void)
+{
+  uint64 n[2] = {0, 0}, sum[2] = {0, 0}, max[2] = {0, 0};
+
+  for(int i = 0; i < NCPU; i++){
+    struct cpu *c = &cpus[i];
+    if(c->nswitch == 0 && c->nidle == 0)
+      continue;
+    printf("cpu%d: %d switches, %d steals, %d idle waits, %d timer interrupts\n",
+           i, c->nswitch, c->nsteal, c->nidle, c->ntimer);
+    for(int rt = 0; rt < 2; rt++){
+      n[rt] += c->nlat[rt];
+      sum[rt] += c->latsum[rt];
+      if(c->latmax[rt] > max[rt])
+        max[rt] = c->latmax[rt];
+    }
+  }
+  for(int rt = 0; rt < 2; rt++){
+    if(n[rt])
+      printf("sched: %s wakeup latency avg %d us, max %d us\n", rt ? "real-time" : "normal",
+             (int)(sum[rt] / n[rt] / 10), (int)(max[rt] / 10));
+  }
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -24,6 +24,22 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+
+  // run queues of RUNNABLE procs, through proc.rqnext;
+  // [1] holds real-time procs, [0] the rest.
+  struct spinlock rqlock;
+  struct proc *rqhead[2];
+  struct proc *rqtail[2];
+  int idle;                   // In wfi, waiting for work?
+  int preempt;                // Real-time proc queued; yield to it
+  uint nswitch;               // procs run
+  uint nsteal;                // procs taken from other queues
+  uint nidle;                 // times it has waited in wfi
+  uint64 nexttick;            // r_time() of the next scheduling tick
+  uint ntimer;                // timer interrupts
+  uint nlat[2];               // wakeup-to-run latency, by class,
+  uint64 latsum[2];           //   in rdtime units
+  uint64 latmax[2];
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,6 +96,14 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// Threads sharing a page table; see clone().
+struct tgroup {
+  struct spinlock lock;
+  int nthread;                 // procs using the page table; 0 if free
+  uint slots;                  // THREADFRAME slots in use, a bit each
+  int execing;                 // exec() is replacing the memory
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -92,6 +116,11 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Run queue p goes on when RUNNABLE
+  struct proc *rqnext;         // Next in the run queue
+  struct proc *wqnext;         // Next in the wait queue, see sleep()
+  int rt;                      // Real-time? see setrt()
+  uint64 wakets;               // r_time() when woken, or 0
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -103,8 +132,11 @@ struct proc {
   uint numPages;
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 tfva;                 // User address of trapframe
+  struct tgroup *tg;           // Threads sharing pagetable, see clone()
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Body of a kernel thread, see kthread()
 };
@@ -0,0 +1,118 @@
+// Shared memory segments.
+//
+// shmmap(key, size) maps the pages of the segment named key,
+// making the segment first if there is none, at the top of
+// the caller's memory. Every process that maps a key sees the
+// same physical pages, and fork() shares them with the child
+// rather than copying them (see PTE_SHM in uvmcopy()), so the
+// player and a decoder it starts can talk through memory, and
+// block on it with futex().
+//
+// shmunlink(key) removes the name. The pages themselves go
+// back to kalloc(), which counts references to each, when the
+// last process mapping them exits, calls exec(), or shrinks
+// its memory past them.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NSHM     16
+#define SHMMAXPG 64   // pages per segment
+
+struct shmseg {
+  int key;
+  int npages;              // 0 if the slot is free
+  uint64 pa[SHMMAXPG];     // the segment's pages; it holds a reference
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shm;
+
+void
+shminit(void)
+{
+  initlock(&shm.lock, "shm");
+}
+
+// Find the segment named key. Caller must hold shm.lock.
+static struct shmseg*
+shmfind(int key)
+{
+  struct shmseg *s;
+
+  for(s = shm.seg; s < &shm.seg[NSHM]; s++)
+    if(s->npages > 0 && s->key == key)
+      return s;
+  return 0;
+}
+
+// Map the first size bytes of segment key into the caller's
+// memory, making a zeroed segment of that size if key names
+// none. Returns the address, or -1.
+uint64
+shmmap(int key, int size)
+{
+  struct shmseg *s;
+  uint64 pa[SHMMAXPG];
+  int i, npages;
+
+  npages = PGROUNDUP((uint64)size) / PGSIZE;
+  if(size <= 0 || npages > SHMMAXPG)
+    return -1;
+
+  acquire(&shm.lock);
+  if((s = shmfind(key)) == 0){
+    for(s = shm.seg; s < &shm.seg[NSHM] && s->npages > 0; s++)
+      ;
+    if(s == &shm.seg[NSHM])
+      goto bad;
+    for(i = 0; i < npages; i++){
+      if((s->pa[i] = (uint64)kzalloc()) == 0){
+        while(--i >= 0)
+          kfree((void*)s->pa[i]);
+        goto bad;
+      }
+    }
+    s->key = key;
+    s->npages = npages;
+  } else if(npages > s->npages){
+    goto bad;
+  }
+  // a reference for the mapping, so that the pages outlive
+  // shmunlink() for as long as they're mapped.
+  for(i = 0; i < npages; i++){
+    pa[i] = s->pa[i];
+    kref((void*)pa[i]);
+  }
+  release(&shm.lock);
+
+  return growshared(pa, npages);
+
+bad:
+  release(&shm.lock);
+  return -1;
+}
+
+// Remove the name key. Processes that have the segment
+// mapped keep it. Returns 0, or -1 if there is no such key.
+int
+shmunlink(int key)
+{
+  struct shmseg *s;
+
+  acquire(&shm.lock);
+  if((s = shmfind(key)) == 0){
+    release(&shm.lock);
+    return -1;
+  }
+  for(int i = 0; i < s->npages; i++)
+    kfree((void*)s->pa[i]);
+  s->npages = 0;
+  release(&shm.lock);
+  return 0;
+}
@@ -0,0 +1,184 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size. Each slab is a
+// page from kalloc() that starts with a struct slab header,
+// followed by as many objects as fit; free objects are chained
+// through their first word. An object's slab is found by
+// rounding its address down to the page.
+//
+// kmalloc() picks a power-of-two cache for small requests, and
+// uses the buddy allocator for anything bigger than a quarter
+// of a page; with the slab header in the page, a bigger cache
+// would fit just one object per slab.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slab *next;        // on the cache's partial or full list
+  struct slab *prev;
+  struct kmem_cache *cache;
+  void *freelist;           // free objects in this slab
+  uint64 nfree;
+};
+
+#define KMMIN   16    // smallest kmalloc() size class
+#define KMMAX   1024  // largest; beyond this kmalloc() uses bd_alloc()
+#define NKMCACHE 7    // 16, 32, ..., 1024
+
+static struct kmem_cache kmcache[NKMCACHE];
+static char *kmnames[NKMCACHE] = {
+  "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+  "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+
+static void
+slabpush(struct slab **head, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *head;
+  if(*head)
+    (*head)->prev = s;
+  *head = s;
+}
+
+static void
+slabunlink(struct slab **head, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *head = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  if(size < sizeof(void*))
+    size = sizeof(void*);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / c->size;
+  if(c->perslab < 1)
+    panic("kmem_cache_init");
+  initlock(&c->lock, name);
+  c->partial = 0;
+  c->full = 0;
+  c->nslab = 0;
+}
+
+void
+slabinit(void)
+{
+  for(int i = 0; i < NKMCACHE; i++)
+    kmem_cache_init(&kmcache[i], kmnames[i], KMMIN << i);
+}
+
+// Get a fresh page from kalloc() and carve it into objects.
+static struct slab*
+newslab(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->next = s->prev = 0;
+  s->cache = c;
+  s->freelist = 0;
+  s->nfree = c->perslab;
+  obj = (char*)(s + 1);
+  for(int i = 0; i < c->perslab; i++, obj += c->size){
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+  }
+  return s;
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  acquire(&c->lock);
+  if((s = c->partial) == 0){
+    release(&c->lock);
+    if((s = newslab(c)) == 0)
+      return 0;
+    acquire(&c->lock);
+    slabpush(&c->partial, s);
+    c->nslab++;
+  }
+  obj = s->freelist;
+  s->freelist = *(void**)obj;
+  if(--s->nfree == 0){
+    slabunlink(&c->partial, s);
+    slabpush(&c->full, s);
+  }
+  release(&c->lock);
+  return obj;
+}
+
+// Return obj to cache c. A slab that becomes empty goes back
+// to kalloc(), unless it's the cache's only partial slab.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->cache != c)
+    panic("kmem_cache_free");
+
+  acquire(&c->lock);
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  if(s->nfree++ == 0){
+    slabunlink(&c->full, s);
+    slabpush(&c->partial, s);
+  }
+  if(s->nfree == c->perslab && (s->next || s->prev)){
+    slabunlink(&c->partial, s);
+    c->nslab--;
+    release(&c->lock);
+    kfree((void*)s);
+    return;
+  }
+  release(&c->lock);
+}
+
+// Allocate n bytes of kernel memory, which need not be a
+// whole page. Returns 0 if out of memory.
+void*
+kmalloc(uint64 n)
+{
+  int i;
+
+  if(n > KMMAX)
+    return bd_alloc(n);
+  for(i = 0; (KMMIN << i) < n; i++)
+    ;
+  return kmem_cache_alloc(&kmcache[i]);
+}
+
+// Free memory returned by kmalloc().
+void
+kmfree(void *p)
+{
+  if((uint64)p >= BUDDYSTART){
+    bd_free(p);
+    return;
+  }
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)p);
+  kmem_cache_free(s->cache, p);
+}
@@ -0,0 +1,11 @@
+// A cache of equal-sized kernel objects, carved out of
+// whole pages by the slab allocator in slab.c.
+struct kmem_cache {
+  char *name;            // for debugging
+  uint size;             // object size, rounded up to 8 bytes
+  uint perslab;          // objects per slab page
+  struct spinlock lock;  // protects the slab lists
+  struct slab *partial;  // slabs with some free objects
+  struct slab *full;     // slabs with no free objects
+  uint nslab;            // slab pages held
+};
@@ -31,18 +31,34 @@ struct signal_lock
 };
 static struct signal_lock pause_lock;
 
+// empty a soundNode, keeping its DMA buffer
+static void clear_node(struct soundNode *node)
+{
+    memset(node->data, 0, DMA_BUF_NUM * DMA_BUF_SIZE);
+    node->flag = 0;
+    node->next = 0;
+}
+
 int sys_setSampleRate(void)
 {
     int rate, i;
     // get the 0th parameter of the system
     if (argint(0, &rate) < 0)
         return -1;
+    // DMA buffers are allocated on first use, so the kernel
+    // doesn't hold them unless something plays audio
+    for (i = 0; i < 3; i++)
+    {
+        if (ac97_buffer[i].data == 0 &&
+            (ac97_buffer[i].data = bd_alloc(DMA_BUF_NUM * DMA_BUF_SIZE)) == 0)
+            return -1;
+    }
     filling_end = 0;
     filling_index = 0;
     // empty the soundNode and put it in the processed state
     for (i = 0; i < 3; i++)
     {
-        memset(&ac97_buffer[i], 0, sizeof(struct soundNode));
+        clear_node(&ac97_buffer[i]);
         ac97_buffer[i].flag = PROCESSED;
     }
     // set sample rate for ac97
@@ -55,7 +71,7 @@ int transfer_data(void)
     // data size of soundNode
     int bufsize = DMA_BUF_NUM * DMA_BUF_SIZE;
     if (filling_end == 0)
-        memset(&ac97_buffer[filling_index], 0, sizeof(struct soundNode));
+        clear_node(&ac97_buffer[filling_index]);
     // if the remaining size of the soundNode is bigger than the data size,
     // write the data to the soundNode
     if (bufsize - filling_end > user_buffer_length)
@@ -73,14 +89,16 @@ int transfer_data(void)
         addSound(&ac97_buffer[filling_index]);
         int flag = 1;
         // find a soundNode that has been processed and write the remaining data to
-        // TODO: non-busy waiting
         while (flag == 1)
         {
+            // sleep until the card is done with a node
+            if (waitSound(ac97_buffer, 3) < 0)
+                return -1;
             for (i = 0; i < 3; ++i)
             {
                 if ((ac97_buffer[i].flag & PROCESSED) == PROCESSED)
                 {
-                    memset(&ac97_buffer[i], 0, sizeof(struct soundNode));
+                    clear_node(&ac97_buffer[i]);
                     if (bufsize > user_buffer_length - temp)
                     {
                         memmove(&ac97_buffer[i].data[0], (user_buffer + temp), (user_buffer_length - temp));
@@ -112,6 +130,10 @@ int sys_kwrite(void)
         sleep(&pause_lock.tag, &pause_lock.lock);
     release(&pause_lock.lock);
 
+    // no buffers until setSampleRate
+    if (ac97_buffer[0].data == 0)
+        return -1;
+
     // read PCM data from user space
     char *buffer;
     if (argint(1, &user_buffer_length) < 0 || argptr(0, &buffer, user_buffer_length) < 0)
@@ -122,9 +144,7 @@ int sys_kwrite(void)
     short *buf_16 = (short *)user_buffer;
     for (int i = 0; i < user_buffer_length / 2; i++)
         buf_16[i] = (short)(buf_16[i] * volume_factor);
-    transfer_data();
-
-    return 0;
+    return transfer_data();
 }
 
 int sys_pause(void)
@@ -176,10 +196,10 @@ int sys_set_volume(void)
     short *buf_16 = (short *)user_buffer;
     for (int i = 0; i < user_buffer_length / 2; i++)
         buf_16[i] = (short)(buf_16[i] * volume_factor);
-    for (int j = 0; j < 3; j++)
+    for (int j = 0; j < 3 && ac97_buffer[j].data; j++)
     {
         short *buf_16 = (short *)ac97_buffer[j].data;
-        for (int i = 0; i < sizeof(ac97_buffer[j].data) / 2; i++)
+        for (int i = 0; i < DMA_BUF_NUM * DMA_BUF_SIZE / 2; i++)
             buf_16[i] = (short)(buf_16[i] * volume_factor);
     }
     return 0;
@@ -132,6 +132,13 @@ extern uint64 sys_kwrite(void);
 extern uint64 sys_pause(void);
 extern uint64 sys_set_volume(void);
 extern uint64 sys_stop_wav(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_setrt(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_shmmap(void);
+extern uint64 sys_shmunlink(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -160,6 +167,13 @@ static uint64 (*syscalls[])(void) = {
 [SYS_pause] sys_pause,
 [SYS_set_volume] sys_set_volume,
 [SYS_stop_wav] sys_stop_wav,
+[SYS_getdents] sys_getdents,
+[SYS_setrt]   sys_setrt,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clone]   sys_clone,
+[SYS_futex]   sys_futex,
+[SYS_shmmap]  sys_shmmap,
+[SYS_shmunlink] sys_shmunlink,
 };
 
 void
@@ -24,4 +24,11 @@
 #define SYS_kwrite 23
 #define SYS_pause 24
 #define SYS_set_volume 25
-#define SYS_stop_wav 26
\ No newline at end of file
+#define SYS_stop_wav 26
+#define SYS_getdents 27
+#define SYS_setrt 28
+#define SYS_nanosleep 29
+#define SYS_clone 30
+#define SYS_futex 31
+#define SYS_shmmap 32
+#define SYS_shmunlink 33
\ No newline at end of file
@@ -29,6 +29,51 @@ sys_fork(void)
   return fork();
 }
 
+// start a thread at fn(arg) on stack, sharing this
+// process's memory; see clone() in proc.c.
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+// wait on, or wake, a user int; see futex() in proc.c.
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(addr, op, val);
+}
+
+// map a shared memory segment; see shm.c.
+uint64
+sys_shmmap(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmmap(key, size);
+}
+
+uint64
+sys_shmunlink(void)
+{
+  int key;
+
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmunlink(key);
+}
+
 uint64
 sys_wait(void)
 {
@@ -83,6 +128,28 @@ sys_kill(void)
   return kill(pid);
 }
 
+// Make this process real-time (on != 0) or ordinary.
+uint64
+sys_setrt(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  setrt(on);
+  return 0;
+}
+
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return nanosleep(ns);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
@@ -0,0 +1,175 @@
+// High-resolution timers.
+//
+// Each hart's CLINT timer is one-shot, set by timerset() to
+// the earlier of the hart's next scheduling tick and the
+// earliest pending kernel timeout. Hart 0 always ticks, to
+// advance ticks; other harts tick only while they are running
+// a process, so an idle hart sleeps in wfi until there is
+// work or a timeout is due.
+//
+// Kernel timeouts (struct timer) are kept in a min-heap on
+// their deadline. Whichever hart's timer goes off first after
+// a deadline wakes up the timeout's channel.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "timer.h"
+
+#define NTIMER (NPROC+8)
+#define NSUNIT 100  // nanoseconds per r_time() unit (10 MHz)
+
+struct {
+  struct spinlock lock;
+  struct timer *heap[NTIMER];  // heap[0] is due first
+  int n;
+} hrt;
+
+void
+hrtinit(void)
+{
+  initlock(&hrt.lock, "hrt");
+}
+
+static void
+hswap(int i, int j)
+{
+  struct timer *t = hrt.heap[i];
+
+  hrt.heap[i] = hrt.heap[j];
+  hrt.heap[j] = t;
+  hrt.heap[i]->idx = i;
+  hrt.heap[j]->idx = j;
+}
+
+// Restore the heap order around heap[i].
+static void
+hfix(int i)
+{
+  int c;
+
+  while(i > 0 && hrt.heap[i]->when < hrt.heap[(i-1)/2]->when){
+    hswap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= hrt.n)
+      break;
+    if(c+1 < hrt.n && hrt.heap[c+1]->when < hrt.heap[c]->when)
+      c++;
+    if(hrt.heap[i]->when <= hrt.heap[c]->when)
+      break;
+    hswap(i, c);
+    i = c;
+  }
+}
+
+// Caller must hold hrt.lock.
+static void
+hadd(struct timer *t)
+{
+  if(hrt.n == NTIMER)
+    panic("hrtadd");
+  t->idx = hrt.n;
+  hrt.heap[hrt.n++] = t;
+  hfix(t->idx);
+}
+
+// Caller must hold hrt.lock.
+static void
+hdel(struct timer *t)
+{
+  int i = t->idx;
+
+  if(i < 0)
+    return;
+  hrt.n--;
+  if(i != hrt.n){
+    hrt.heap[i] = hrt.heap[hrt.n];
+    hrt.heap[i]->idx = i;
+    hfix(i);
+  }
+  t->idx = -1;
+}
+
+// Wake up the channels of timeouts that are due. The
+// wakeups happen after releasing hrt.lock, since wakeup()
+// takes p->locks and the scheduler calls timerset() with
+// one held.
+void
+hrtexpire(void)
+{
+  uint64 now = r_time();
+  void *chans[16];
+  int i, n;
+
+  do {
+    n = 0;
+    acquire(&hrt.lock);
+    while(n < NELEM(chans) && hrt.n > 0 && hrt.heap[0]->when <= now){
+      chans[n++] = hrt.heap[0]->chan;
+      hdel(hrt.heap[0]);
+    }
+    release(&hrt.lock);
+    for(i = 0; i < n; i++)
+      wakeup(chans[i]);
+  } while(n == NELEM(chans));
+}
+
+// Set this hart's timer to its next tick or the first
+// timeout, whichever is sooner.
+void
+timerset(void)
+{
+  struct cpu *c;
+  uint64 when, now;
+  int id;
+
+  push_off();
+  c = mycpu();
+  id = cpuid();
+  now = r_time();
+  if(id != 0 && c->proc && c->nexttick < now){
+    // coming out of idle: a fresh time slice.
+    c->nexttick = now + TICKINTERVAL;
+  }
+  when = (id == 0 || c->proc) ? c->nexttick : ~0ULL;
+  acquire(&hrt.lock);
+  if(hrt.n > 0 && hrt.heap[0]->when < when)
+    when = hrt.heap[0]->when;
+  release(&hrt.lock);
+  *(uint64*)CLINT_MTIMECMP(id) = when;
+  pop_off();
+}
+
+// Sleep for ns nanoseconds, with a resolution of about a
+// microsecond rather than a tick. Returns -1 if killed.
+int
+nanosleep(uint64 ns)
+{
+  struct timer t;
+
+  t.when = r_time() + ns / NSUNIT;
+  t.chan = &t;
+  acquire(&hrt.lock);
+  hadd(&t);
+  release(&hrt.lock);
+  timerset();  // this hart's timer may need to go off sooner
+
+  acquire(&hrt.lock);
+  while(t.idx >= 0){
+    if(myproc()->killed){
+      hdel(&t);
+      release(&hrt.lock);
+      return -1;
+    }
+    sleep(&t, &hrt.lock);
+  }
+  release(&hrt.lock);
+  return 0;
+}
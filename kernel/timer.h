@@ -0,0 +1,7 @@
+// A kernel timeout: wakes up chan at time when (in r_time()
+// units). See timer.c.
+struct timer {
+  uint64 when;
+  void *chan;
+  int idx;      // index in the timer heap, or -1 if not in it
+};
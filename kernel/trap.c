@@ -15,6 +15,7 @@ extern char trampoline[], uservec[], userret[];
 void kernelvec();
 
 extern int devintr();
+extern uint64 timer_scratch[NCPU][6];  // start.c
 
 void
 trapinit(void)
@@ -67,6 +68,10 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            proclazy(p, r_stval()) == 0){
+    // load or store page fault on a heap page that
+    // sbrk() reserved; it's mapped now.
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -77,7 +82,8 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // a real-time process keeps the CPU until it sleeps.
+  if(which_dev == 2 && !p->rt)
     yield();
 
   usertrapret();
@@ -125,7 +131,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->tfva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -150,7 +156,7 @@ kerneltrap()
   }
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && !myproc()->rt)
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -166,11 +172,21 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  logtick();
+}
+
+// Interrupt CPU id: to wake it from wfi in scheduler(),
+// or to make it yield. The machine-mode handler, timervec,
+// turns the IPI into a supervisor software interrupt.
+void
+ipi(int id)
+{
+  *(uint32*)CLINT_MSIP(id) = 1;
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
+// returns 2 if timer tick or IPI,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -203,18 +219,39 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
-
-    if(cpuid() == 0){
-      clockintr();
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S. The timer
+    // flag says whether the timer went off; if so, it may be
+    // time for a tick, or for kernel timeouts, or both.
+    int which = 2;
+
+    if(__sync_lock_test_and_set(&timer_scratch[cpuid()][5], 0)){
+      struct cpu *c = mycpu();
+      uint64 now = r_time();
+      c->ntimer++;
+      if(now >= c->nexttick){
+        c->nexttick += TICKINTERVAL;
+        if(c->nexttick <= now)
+          c->nexttick = now + TICKINTERVAL;
+        if(cpuid() == 0)
+          clockintr();
+      } else {
+        which = 1;  // not a tick; don't yield
+      }
+      hrtexpire();
+      timerset();
     }
+
+    // an IPI asking this CPU to make way for a real-time
+    // process may have come along with a timer interrupt.
+    if(__sync_lock_test_and_set(&mycpu()->preempt, 0))
+      which = 2;
     
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    return which;
   } else {
     return 0;
   }
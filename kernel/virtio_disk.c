@@ -22,10 +22,10 @@
 
 static struct disk {
   // the virtio driver and device mostly communicate through a set of
-  // structures in RAM. pages[] allocates that memory. pages[] is a
-  // global (instead of calls to kalloc()) because it must consist of
+  // structures in RAM. pages[] points to that memory. it comes from
+  // bd_alloc() (instead of kalloc()) because it must consist of
   // two contiguous pages of page-aligned physical memory.
-  char pages[2*PGSIZE];
+  char *pages;
 
   // pages[] is divided into three regions (descriptors, avail, and
   // used), as explained in Section 2.6 of the virtio specification
@@ -56,6 +56,9 @@ static struct disk {
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
   uint16 used_idx; // we've looked this far in used[2..NUM].
+  int nqueued;     // requests on the avail ring not yet notified
+  uint nreq;       // requests submitted, for statistics
+  uint nblk;       // blocks transferred, for statistics
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
@@ -63,6 +66,8 @@ static struct disk {
   struct {
     struct buf *b;
     char status;
+    char async;    // completed by virtio_disk_intr(), not the caller
+    char direct;   // virtio_disk_read_direct() is waiting for it
   } info[NUM];
 
   // disk command headers.
@@ -71,7 +76,7 @@ static struct disk {
   
   struct spinlock vdisk_lock;
   
-} __attribute__ ((aligned (PGSIZE))) disk;
+} disk;
 
 void
 virtio_disk_init(void)
@@ -122,7 +127,9 @@ virtio_disk_init(void)
   if(max < NUM)
     panic("virtio disk max queue too short");
   *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
+  if((disk.pages = bd_alloc(2*PGSIZE)) == 0)
+    panic("virtio disk bd_alloc");
+  memset(disk.pages, 0, 2*PGSIZE);
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
 
   // desc = pages -- num * virtq_desc
@@ -184,12 +191,13 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
+// a disk transfer uses one for the request header, one per
+// data segment, and one for the status.
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -200,27 +208,43 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// tell the device about all requests put on the avail ring
+// since the last notify. caller must hold disk.vdisk_lock.
+static void
+notify(void)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  if(disk.nqueued == 0)
+    return;
+  disk.nqueued = 0;
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
 
+// put one request on the avail ring to transfer the disk
+// sectors starting at sector to or from the nseg memory
+// segments addrs[i], lens[i], without telling the device
+// yet. returns the index of the first descriptor, for
+// disk.info[]. caller must hold disk.vdisk_lock.
+static int
+submitv(uint64 sector, uint64 *addrs, uint *lens, int nseg, int write)
+{
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // a chain of descriptors: one for type/reserved/sector, then
+  // the data, then one for a 1-byte status result. each memory
+  // segment gets its own data descriptor.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the descriptors.
+  int idx[MAXSEG+2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, nseg+2) == 0) {
       break;
     }
+    // the descriptors we're waiting for may belong to requests
+    // the device hasn't been told about.
+    notify();
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -237,24 +261,23 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 0; i < nseg; i++){
+    int d = idx[1+i];
+    disk.desc[d].addr = addrs[i];
+    disk.desc[d].len = lens[i];
+    if(write)
+      disk.desc[d].flags = 0; // device reads the segment
+    else
+      disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes it
+    disk.desc[d].flags |= VRING_DESC_F_NEXT;
+    disk.desc[d].next = idx[2+i];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.desc[idx[nseg+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[nseg+1]].len = 1;
+  disk.desc[idx[nseg+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[nseg+1]].next = 0;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -266,16 +289,117 @@ virtio_disk_rw(struct buf *b, int write)
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  disk.nqueued++;
+  disk.nreq++;
+  return idx[0];
+}
+
+// put one request on the avail ring for the n buffers bs[],
+// which hold consecutive blocks, without telling the device
+// yet. caller must hold disk.vdisk_lock.
+static void
+submit(struct buf **bs, int n, int write, int async)
+{
+  uint64 addrs[MAXSEG];
+  uint lens[MAXSEG];
+  int id;
+
+  for(int i = 0; i < n; i++){
+    addrs[i] = (uint64) bs[i]->data;
+    lens[i] = BSIZE;
+    // record struct buf for virtio_disk_intr().
+    bs[i]->disk = 1;
+    bs[i]->qnext = i+1 < n ? bs[i+1] : 0;
+  }
+  id = submitv(bs[0]->blockno * (BSIZE / 512), addrs, lens, n, write);
+  disk.info[id].b = bs[0];
+  disk.info[id].async = async;
+  disk.nblk += n;
+}
+
+// Queue requests to read or write the n buffers bs[], which
+// the caller has locked, without waiting for them or telling
+// the device; virtio_disk_kick() does that, so that a batch of
+// requests costs one notify. Runs of buffers that hold
+// consecutive blocks go in a single request, up to MAXSEG
+// blocks. If async is set, virtio_disk_intr() hands each
+// buffer back to the buffer cache with bprefetchdone() when
+// its read finishes; otherwise wait with virtio_disk_wait().
+void
+virtio_disk_start(struct buf **bs, int n, int write, int async)
+{
+  int i, j;
+
+  acquire(&disk.vdisk_lock);
+  for(i = 0; i < n; i = j){
+    for(j = i+1; j < n && j-i < MAXSEG; j++)
+      if(bs[j]->dev != bs[j-1]->dev || bs[j]->blockno != bs[j-1]->blockno + 1)
+        break;
+    submit(bs+i, j-i, write, async);
+  }
+  release(&disk.vdisk_lock);
+}
+
+// Tell the device about requests queued by virtio_disk_start().
+void
+virtio_disk_kick(void)
+{
+  acquire(&disk.vdisk_lock);
+  notify();
+  release(&disk.vdisk_lock);
+}
+
+// Wait for the request for b to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  notify();
+  while(b->disk == 1) {
+    sleep(b, &disk.vdisk_lock);
+  }
+  release(&disk.vdisk_lock);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+
+  submit(&b, 1, write, 0);
+  notify();
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  release(&disk.vdisk_lock);
+}
+
+// Read consecutive blocks starting at blockno straight into the
+// nseg physical memory segments addrs[i], lens[i], bypassing
+// the buffer cache, and wait for the read to finish. The
+// segments must add up to whole blocks. For O_DIRECT reads.
+void
+virtio_disk_read_direct(uint blockno, uint64 *addrs, uint *lens, int nseg)
+{
+  int id, n = 0;
+
+  if(nseg > MAXSEG)
+    panic("virtio_disk_read_direct");
+  for(int i = 0; i < nseg; i++)
+    n += lens[i];
 
+  acquire(&disk.vdisk_lock);
+  id = submitv((uint64)blockno * (BSIZE / 512), addrs, lens, nseg, 0);
+  disk.info[id].b = 0;
+  disk.info[id].direct = 1;
+  disk.nblk += n / BSIZE;
+  notify();
+  while(disk.info[id].direct)
+    sleep(&disk.info[id], &disk.vdisk_lock);
+  free_chain(id);
   release(&disk.vdisk_lock);
 }
 
@@ -295,7 +419,8 @@ virtio_disk_intr()
   __sync_synchronize();
 
   // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  // adds an entry to the used ring. handle every request
+  // that has finished, not just one.
 
   while(disk.used_idx != disk.used->idx){
     __sync_synchronize();
@@ -304,12 +429,37 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    if(disk.info[id].direct){
+      // virtio_disk_read_direct() frees the descriptors.
+      disk.info[id].direct = 0;
+      wakeup(&disk.info[id]);
+      disk.used_idx += 1;
+      continue;
+    }
+
+    struct buf *b = disk.info[id].b, *next;
+    int async = disk.info[id].async;
+    disk.info[id].b = 0;
+    free_chain(id);
+    for(; b; b = next){
+      next = b->qnext;
+      b->disk = 0;   // disk is done with buf
+      if(async)
+        bprefetchdone(b);
+      else
+        wakeup(b);
+    }
 
     disk.used_idx += 1;
   }
 
   release(&disk.vdisk_lock);
 }
+
+// Print how many blocks each request carried, on average.
+// Runs when user types ^T on console.
+void
+virtio_disk_stats(void)
+{
+  printf("virtio: %d requests, %d blocks\n", disk.nreq, disk.nblk);
+}
@@ -40,6 +40,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void iextent(uint inum, int fd);
 void die(const char *);
 
 // convert to intel byte order
@@ -130,11 +131,13 @@ main(int argc, char *argv[])
   for(i = 2; i < argc; i++){
     // get rid of "user/" "audio"
     char *shortname;
+    int audio = 0;
     if(strncmp(argv[i], "user/", 5) == 0)
       shortname = argv[i] + 5;
-    else if(strncmp(argv[i], "audio/", 6) == 0)
+    else if(strncmp(argv[i], "audio/", 6) == 0){
       shortname = argv[i] + 6;
-    else
+      audio = 1;
+    } else
       shortname = argv[i];
     
     assert(index(shortname, '/') == 0);
@@ -149,14 +152,18 @@ main(int argc, char *argv[])
     if(shortname[0] == '_')
       shortname += 1;
 
-    inum = ialloc(T_FILE);
+    // audio files are big and read start to end, so store
+    // each one as a single run of consecutive blocks.
+    inum = ialloc(audio ? T_EXTENT : T_FILE);
 
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, shortname, DIRSIZ);
     iappend(rootino, &de, sizeof(de));
 
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
+    if(audio)
+      iextent(inum, fd);
+    else while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
 
     close(fd);
@@ -295,6 +302,33 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+// Copy the file open on fd into T_EXTENT inode inum,
+// as one extent starting at freeblock.
+void
+iextent(uint inum, int fd)
+{
+  struct dinode din;
+  char buf[BSIZE];
+  uint start, off;
+  int cc;
+
+  rinode(inum, &din);
+  start = freeblock;
+  off = 0;
+  while((cc = read(fd, buf, sizeof(buf))) > 0){
+    assert(freeblock < FSSIZE);
+    bzero(buf + cc, BSIZE - cc);
+    wsect(freeblock++, buf);
+    off += cc;
+  }
+  if(off > 0){
+    din.addrs[0] = xint(start);
+    din.addrs[1] = xint(freeblock - start);
+  }
+  din.size = xint(off);
+  winode(inum, &din);
+}
+
 void
 die(const char *s)
 {
@@ -0,0 +1,451 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+
+//
+// Kernel microbenchmarks. bench without arguments runs them
+// all, and bench <name> runs just <name>. Times come from the
+// rdtime counter; kernel-side counters (lock contention, cache
+// hits, &c) are printed by typing ^T on the console.
+//
+
+#define NS(t) ((t) * 100)  // rdtime ticks at 10 MHz
+
+// allocate, first-touch, and free heap pages. each touch takes
+// a page fault that kzalloc()s a page, and the sbrk(-n) frees
+// them all again.
+void
+pagealloc(char *s)
+{
+  enum { NPAGE = 4096, ROUNDS = 8 };
+  uint64 t0, t1, tfault = 0, tfree = 0;
+  char *a;
+  int i, r;
+
+  for(r = 0; r < ROUNDS; r++){
+    a = sbrk(NPAGE*PGSIZE);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk failed\n", s);
+      exit(1);
+    }
+    t0 = rdtime();
+    for(i = 0; i < NPAGE; i++)
+      a[i*PGSIZE] = 1;
+    t1 = rdtime();
+    sbrk(-NPAGE*PGSIZE);
+    tfree += rdtime() - t1;
+    tfault += t1 - t0;
+  }
+  printf("%s: %d ns per page fault, %d ns per page freed\n", s,
+         (int)(NS(tfault) / (NPAGE*ROUNDS)), (int)(NS(tfree) / (NPAGE*ROUNDS)));
+}
+
+// fork and reap children in a loop. each fork copies the
+// parent's pages and allocates a trapframe and page table.
+void
+forkexit(char *s)
+{
+  enum { N = 200 };
+  uint64 t0;
+  int i, pid;
+
+  t0 = rdtime();
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  printf("%s: %d us per fork+exit+wait\n", s, (int)(NS(rdtime() - t0) / N / 1000));
+}
+
+// re-read a file that fits in the buffer cache. the kernel
+// copies every byte out of a different cache block through its
+// direct map of RAM, so this is mostly kernel TLB pressure.
+void
+tlb(char *s)
+{
+  enum { FSZ = 2*1024*1024, ROUNDS = 20 };
+  static char buf[64*1024];
+  uint64 t0;
+  int fd, i, r, n;
+
+  fd = open("bench.tlb", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < FSZ; i += sizeof(buf)){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  t0 = rdtime();
+  for(r = 0; r < ROUNDS; r++){
+    fd = open("bench.tlb", O_RDONLY);
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      ;
+    close(fd);
+  }
+  printf("%s: %d KB/s re-reading a cached %d KB file\n", s,
+         (int)((uint64)FSZ / 1024 * ROUNDS * 10000000 / (rdtime() - t0)), FSZ / 1024);
+  unlink("bench.tlb");
+}
+
+// several processes each repeatedly read their own small file.
+// every read looks the inode and data blocks up in the buffer
+// cache, so this shows how well cache hits scale across harts.
+void
+bcachehit(char *s)
+{
+  enum { NCHILD = 4, ROUNDS = 2000 };
+  char name[16], buf[512];
+  uint64 t0;
+  int fd, i, r, pid;
+
+  t0 = rdtime();
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      strcpy(name, "bench.bc0");
+      name[8] += i;
+      fd = open(name, O_CREATE|O_RDWR);
+      if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: create failed\n", s);
+        exit(1);
+      }
+      close(fd);
+      for(r = 0; r < ROUNDS; r++){
+        fd = open(name, O_RDONLY);
+        read(fd, buf, sizeof(buf));
+        close(fd);
+      }
+      unlink(name);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++)
+    wait(0);
+  printf("%s: %d us per open+read+close, %d processes\n", s,
+         (int)(NS(rdtime() - t0) / ROUNDS / 1000), NCHILD);
+}
+
+// read a file twice the size of the buffer cache from start
+// to end, so every block misses, the way the player streams a
+// large audio file. read-ahead should overlap the disk reads.
+void
+seqread(char *s)
+{
+  enum { FSZ = 6*1024*1024 };
+  static char buf[4096];
+  uint64 t0;
+  int fd, i, n, tot;
+
+  fd = open("bench.seq", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < FSZ; i += sizeof(buf)){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  t0 = rdtime();
+  fd = open("bench.seq", O_RDONLY);
+  tot = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    tot += n;
+  close(fd);
+  printf("%s: %d KB/s reading %d KB in %d byte reads\n", s,
+         (int)((uint64)tot / 1024 * 10000000 / (rdtime() - t0)), tot / 1024, (int)sizeof(buf));
+  unlink("bench.seq");
+}
+
+// two processes write 2 MB files at the same time, then each
+// file is read back. if the writers' blocks interleave on disk,
+// the reads can't be merged into large disk requests.
+void
+twowrite(char *s)
+{
+  enum { FSZ = 2*1024*1024, NCHILD = 2 };
+  static char buf[4096];
+  char name[16];
+  uint64 t0, t1;
+  int fd, i, n, pid;
+
+  t0 = rdtime();
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      strcpy(name, "bench.tw0");
+      name[8] += i;
+      fd = open(name, O_CREATE|O_RDWR);
+      if(fd < 0){
+        printf("%s: create failed\n", s);
+        exit(1);
+      }
+      for(n = 0; n < FSZ; n += sizeof(buf)){
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
+        }
+      }
+      close(fd);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++)
+    wait(0);
+  t1 = rdtime();
+
+  strcpy(name, "bench.tw0");
+  for(i = 0; i < NCHILD; i++){
+    name[8] = '0' + i;
+    fd = open(name, O_RDONLY);
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+    unlink(name);
+  }
+  printf("%s: %d KB/s writing, %d KB/s reading back, %d files of %d KB\n", s,
+         (int)((uint64)FSZ / 1024 * NCHILD * 10000000 / (t1 - t0)),
+         (int)((uint64)FSZ / 1024 * NCHILD * 10000000 / (rdtime() - t1)),
+         NCHILD, FSZ / 1024);
+}
+
+// create, write, and delete many small files. every create
+// rewrites the same directory, inode and bitmap blocks, so the
+// log should absorb most of the writes, and install them at a
+// checkpoint rather than after each create.
+void
+smallfile(char *s)
+{
+  enum { N = 200 };
+  char name[16], buf[100];
+  uint64 t0;
+  int fd, i;
+
+  memset(buf, 'x', sizeof(buf));
+  t0 = rdtime();
+  for(i = 0; i < N; i++){
+    strcpy(name, "bench.sf");
+    name[8] = 'a' + i / 26 % 26;
+    name[9] = 'a' + i % 26;
+    name[10] = 0;
+    fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < N; i++){
+    name[8] = 'a' + i / 26 % 26;
+    name[9] = 'a' + i % 26;
+    unlink(name);
+  }
+  printf("%s: %d us per create+write, %d files\n", s,
+         (int)(NS(rdtime() - t0) / N / 1000), N);
+}
+
+// name of the ith file in dirlookup's small or big directory.
+static void
+dname(char *name, int big, int i)
+{
+  char *p;
+
+  strcpy(name, big ? "bench.dbig/f0000" : "bench.dsmall/f0000");
+  p = name + strlen(name);
+  p[-4] += i / 1000 % 10;
+  p[-3] += i / 100 % 10;
+  p[-2] += i / 10 % 10;
+  p[-1] += i % 10;
+}
+
+// open a file in a directory of 8 entries and in one of 1000,
+// to see whether lookups cost more in a large directory.
+void
+dirlookup(char *s)
+{
+  enum { NBIG = 1000, ROUNDS = 500 };
+  char name[32];
+  uint64 t0, t1, t2;
+  int fd, i, r, ndir, n;
+
+  mkdir("bench.dsmall");
+  mkdir("bench.dbig");
+  for(ndir = 0; ndir < 2; ndir++){
+    n = ndir ? NBIG : 8;
+    for(i = 0; i < n; i++){
+      dname(name, ndir, i);
+      fd = open(name, O_CREATE|O_RDWR);
+      if(fd < 0){
+        printf("%s: create failed\n", s);
+        exit(1);
+      }
+      close(fd);
+    }
+  }
+
+  // look up the last entry of each directory.
+  t0 = rdtime();
+  for(r = 0; r < ROUNDS; r++)
+    close(open("bench.dsmall/f0007", O_RDONLY));
+  t1 = rdtime();
+  for(r = 0; r < ROUNDS; r++)
+    close(open("bench.dbig/f0999", O_RDONLY));
+  t2 = rdtime();
+  printf("%s: %d us per open in a %d-entry dir, %d us in a %d-entry dir\n", s,
+         (int)(NS(t1 - t0) / ROUNDS / 1000), 8,
+         (int)(NS(t2 - t1) / ROUNDS / 1000), NBIG);
+
+  for(ndir = 0; ndir < 2; ndir++){
+    n = ndir ? NBIG : 8;
+    for(i = 0; i < n; i++){
+      dname(name, ndir, i);
+      unlink(name);
+    }
+  }
+  unlink("bench.dsmall");
+  unlink("bench.dbig");
+}
+
+// wakeup-to-run latency of a process blocked in read() on a
+// pipe, with spinning processes keeping every hart busy: first
+// as an ordinary process, then as a real-time one (setrt()).
+void
+wakelat(char *s)
+{
+  enum { NSPIN = 8, N = 50 };
+  int spin[NSPIN], fds[2], i, rt, pid;
+  uint64 t, lat, sum, max;
+
+  for(i = 0; i < NSPIN; i++){
+    if((spin[i] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(spin[i] == 0)
+      for(;;)
+        ;
+  }
+
+  for(rt = 0; rt < 2; rt++){
+    if(pipe(fds) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    pid = fork();
+    if(pid == 0){
+      setrt(rt);
+      close(fds[1]);
+      sum = max = 0;
+      for(i = 0; i < N; i++){
+        if(read(fds[0], &t, sizeof(t)) != sizeof(t))
+          exit(1);
+        lat = rdtime() - t;
+        sum += lat;
+        if(lat > max)
+          max = lat;
+      }
+      printf("%s: %s: avg %d us, max %d us\n", s, rt ? "real-time" : "normal",
+             (int)(NS(sum) / N / 1000), (int)(NS(max) / 1000));
+      exit(0);
+    }
+    close(fds[0]);
+    for(i = 0; i < N; i++){
+      sleep(1);
+      t = rdtime();
+      write(fds[1], &t, sizeof(t));
+    }
+    close(fds[1]);
+    wait(0);
+  }
+
+  for(i = 0; i < NSPIN; i++){
+    kill(spin[i]);
+    wait(0);
+  }
+}
+
+// how long nanosleep() actually sleeps, for requests well
+// under the 100 ms scheduling tick.
+void
+nsleep(char *s)
+{
+  enum { N = 20 };
+  static uint64 req[] = { 100000, 1000000, 10000000 };  // ns
+  uint64 t0, ns;
+  int i, j;
+
+  for(i = 0; i < sizeof(req)/sizeof(req[0]); i++){
+    t0 = rdtime();
+    for(j = 0; j < N; j++){
+      if(nanosleep(req[i]) < 0){
+        printf("%s: nanosleep failed\n", s);
+        exit(1);
+      }
+    }
+    ns = NS(rdtime() - t0) / N;
+    printf("%s: asked for %d us, slept %d us\n", s, (int)(req[i] / 1000), (int)(ns / 1000));
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *justone = 0;
+
+  if(argc == 2)
+    justone = argv[1];
+  else if(argc > 2){
+    printf("Usage: bench [benchname]\n");
+    exit(1);
+  }
+
+  struct bench {
+    void (*f)(char *);
+    char *s;
+  } benches[] = {
+    {pagealloc, "pagealloc"},
+    {forkexit, "forkexit"},
+    {tlb, "tlb"},
+    {bcachehit, "bcachehit"},
+    {seqread, "seqread"},
+    {twowrite, "twowrite"},
+    {smallfile, "smallfile"},
+    {dirlookup, "dirlookup"},
+    {wakelat, "wakelat"},
+    {nsleep, "nanosleep"},
+    { 0, 0},
+  };
+
+  for(struct bench *b = benches; b->s != 0; b++)
+    if(justone == 0 || strcmp(b->s, justone) == 0)
+      b->f(b->s);
+  exit(0);
+}
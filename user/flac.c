@@ -36,6 +36,44 @@ char* getFileBuffer(const char* fname, int* size)
     close(fd);
     return file_buf;
 }
+
+#define NRING 4 // decoded frames waiting for the writer
+
+// Decoded frames go from the decoder (main) to a writer thread
+// through a ring, so that decoding the next frames overlaps with
+// kwrite() waiting for the sound card.
+struct {
+    struct mutex lock;
+    struct cond nonempty, nonfull;
+    uint8_t* buf[NRING];
+    uint32_t len[NRING];
+    int head, tail; // frames put in, frames taken out
+    int done;       // no more frames coming
+} ring;
+
+void writer(void* arg) {
+    int i;
+
+    for(;;) {
+        mutex_lock(&ring.lock);
+        while(ring.tail == ring.head && !ring.done)
+            cond_wait(&ring.nonempty, &ring.lock);
+        if(ring.tail == ring.head) {
+            mutex_unlock(&ring.lock);
+            exit(0);
+        }
+        i = ring.tail % NRING;
+        mutex_unlock(&ring.lock);
+
+        kwrite(ring.buf[i], ring.len[i]);
+
+        mutex_lock(&ring.lock);
+        ring.tail++;
+        cond_signal(&ring.nonfull);
+        mutex_unlock(&ring.lock);
+    }
+}
+
 typedef struct {
     uint8_t* buffer;
     uint32_t pos;
@@ -52,6 +90,7 @@ int main(int argc, const char* argv[]) {
     miniflac_t* decoder = NULL;
     int32_t** samples = NULL;
     uint8_t* outSamples = NULL;
+    char* stack = NULL;
 
     membuffer_t mem;
 
@@ -71,8 +110,13 @@ int main(int argc, const char* argv[]) {
         samples[i] = (int32_t *)malloc(sizeof(int32_t) * 65535);
         if(samples[i] == 0) abort("Malloc error!");
     }
-    outSamples = (uint8_t*)malloc(sizeof(int32_t) * 8 * 65535);
-    if(outSamples == 0) abort("Malloc error!");
+    for(i=0;i<NRING;i++) {
+        ring.buf[i] = (uint8_t*)malloc(sizeof(int32_t) * 8 * 65535);
+        if(ring.buf[i] == 0) abort("Malloc error!");
+    }
+    stack = malloc(4096);
+    if(stack == 0) abort("Malloc error!");
+    if(clone(writer, 0, (void*)(((uint64)stack + 4096) & ~15)) < 0) abort("Fail to start the writer!");
 
     miniflac_init(decoder, MINIFLAC_CONTAINER_UNKNOWN);
     if(miniflac_sync(decoder,&mem.buffer[mem.pos],mem.len,&used) != MINIFLAC_OK) printf("err");
@@ -106,13 +150,27 @@ int main(int argc, const char* argv[]) {
             sampSize = 3; pack = int24_packer; shift = 24 - decoder->frame.header.bps;
         } else if(decoder->frame.header.bps <= 32) {
             sampSize = 4; pack = int32_packer; shift = 32 - decoder->frame.header.bps;
-        } else abort("Not supported format!");
+        } else {
+            printf("Not supported format!\n");
+            break;
+        }
 
         len = sampSize * decoder->frame.header.channels * decoder->frame.header.block_size;
 
+        mutex_lock(&ring.lock);
+        while(ring.head - ring.tail == NRING)
+            cond_wait(&ring.nonfull, &ring.lock);
+        outSamples = ring.buf[ring.head % NRING];
+        mutex_unlock(&ring.lock);
+
         /* samples is planar, convert into an interleaved format, and pack into little-endian */
         pack(outSamples,samples,decoder->frame.header.channels,decoder->frame.header.block_size,shift);
-        kwrite(outSamples,len);
+
+        mutex_lock(&ring.lock);
+        ring.len[ring.head % NRING] = len;
+        ring.head++;
+        cond_signal(&ring.nonempty);
+        mutex_unlock(&ring.lock);
 
         /* sync up to the next frame boundary */
         res = miniflac_sync(decoder,&mem.buffer[mem.pos],mem.len,&used);
@@ -132,8 +190,16 @@ int main(int argc, const char* argv[]) {
         }
         free(samples);
     }
-    if(outSamples)
-        free(outSamples);
+    // let the writer finish the ring, and wait for it.
+    mutex_lock(&ring.lock);
+    ring.done = 1;
+    cond_signal(&ring.nonempty);
+    mutex_unlock(&ring.lock);
+    wait(0);
+
+    for(i=0;i<NRING;i++)
+        free(ring.buf[i]);
+    free(stack);
     if(decoder)
         free(decoder);
     exit(0);
@@ -25,9 +25,8 @@ fmtname(char *path)
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, i, n;
+  struct dirinfo di[32];
   struct stat st;
 
   if((fd = open(path, 0)) < 0){
@@ -43,27 +42,14 @@ ls(char *path)
 
   switch(st.type){
   case T_FILE:
+  case T_EXTENT:
     printf("%s %d %d %l\n", fmtname(path), st.type, st.ino, st.size);
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
-      printf("ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
-      }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
+    while((n = getdents(fd, di, sizeof(di)/sizeof(di[0]))) > 0){
+      for(i = 0; i < n; i++)
+        printf("%s %d %d %d\n", fmtname(di[i].name), di[i].type, di[i].inum, di[i].size);
     }
     break;
   }
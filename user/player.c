@@ -38,8 +38,8 @@ fmtname(char *path)
 void show_audioList()
 {
     char buf[512], *p;
-    int fd;
-    struct dirent de;
+    int fd, i, n;
+    struct dirinfo di[32];
     struct stat st;
     int cnt = 0, pos = 0;
     char path[] = ".";
@@ -59,32 +59,32 @@ void show_audioList()
     strcpy(buf, path);
     p = buf + strlen(buf);
     *p++ = '/';
-    while (read(fd, &de, sizeof(de)) == sizeof(de))
+    while ((n = getdents(fd, di, sizeof(di) / sizeof(di[0]))) > 0)
     {
-        if (de.inum == 0)
-            continue;
-        memmove(p, de.name, DIRSIZ);
-        p[DIRSIZ] = 0;
-        char *extensionname, *name;
-        char tmp[] = " ";
-        name = buf;
-        for (pos = 1; pos < strlen(name); pos++)
+        for (i = 0; i < n; i++)
         {
-            if (name[pos] == '.')
-                break;
-        }
-        if (pos <= 2)
-            extensionname = tmp;
-        else
-            extensionname = name + pos;
-        if (strcmp(extensionname, ".mp3") == 0 || strcmp(extensionname, ".wav") == 0 || strcmp(extensionname, ".flac") == 0)
-        {
-            printf("%s ", fmtname(name));
-            cnt++;
-            if (cnt == 4)
+            strcpy(p, di[i].name);
+            char *extensionname, *name;
+            char tmp[] = " ";
+            name = buf;
+            for (pos = 1; pos < strlen(name); pos++)
+            {
+                if (name[pos] == '.')
+                    break;
+            }
+            if (pos <= 2)
+                extensionname = tmp;
+            else
+                extensionname = name + pos;
+            if (strcmp(extensionname, ".mp3") == 0 || strcmp(extensionname, ".wav") == 0 || strcmp(extensionname, ".flac") == 0)
             {
-                cnt = 0;
-                printf("\n");
+                printf("%s ", fmtname(name));
+                cnt++;
+                if (cnt == 4)
+                {
+                    cnt = 0;
+                    printf("\n");
+                }
             }
         }
     }
@@ -184,6 +184,8 @@ int main(void)
             }
             extensionname = name + pos;
             play_pid = fork();
+            if (play_pid == 0)
+                setrt(1); // keep the audio fed under load
             if (play_pid == 0 && strcmp(extensionname, ".wav") == 0)
                 play_wav(input_str + 5);
             else if (play_pid == 0 && strcmp(extensionname, ".mp3") == 0)
@@ -1,5 +1,9 @@
+#ifndef USER_USER_H
+#define USER_USER_H
+
 struct stat;
 struct rtcdate;
+struct dirinfo;
 
 // system calls
 int fork(void);
@@ -29,6 +33,13 @@ int wavdecode();
 int kwrite(void*, int);
 int stop_wav();
 int set_volume(int);
+int getdents(int, struct dirinfo*, int);
+int setrt(int);
+int nanosleep(uint64);
+int clone(void (*)(void*), void*, void*);
+int futex(int*, int, int);
+char* shmmap(int, int);
+int shmunlink(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -47,3 +58,20 @@ int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
 int parseInt(char*);
+uint64 rdtime(void);
+
+// ulib.c: locks for threads (see clone()) and for processes
+// sharing memory, which block with futex().
+struct mutex {
+  int state;  // 0 unlocked, 1 locked, 2 locked with waiters
+};
+struct cond {
+  int seq;    // bumped by every signal
+};
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+
+#endif // USER_USER_H
@@ -4,6 +4,7 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/futex.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -2617,6 +2618,379 @@ sbrk8000(char *s)
   *(top-1) = *(top-1) + 1;
 }
 
+int countfree();
+
+// does sbrk() only reserve address space, with pages showing up
+// as they're first touched? can the kernel read() into, and
+// fork() copy, heap pages the process hasn't touched yet?
+void
+lazysbrk(char *s)
+{
+  enum { BIG=32*1024*1024 };
+  int free0, free1, fds[2], pid, xstatus;
+  char *a;
+
+  free0 = countfree();
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(BIG) failed\n", s);
+    exit(1);
+  }
+  free1 = countfree();
+  if(free0 - free1 > 16){
+    printf("%s: sbrk allocated %d pages up front\n", s, free0 - free1);
+    exit(1);
+  }
+
+  // copyout() into an untouched page.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  write(fds[1], "x", 1);
+  if(read(fds[0], a + BIG/2, 1) != 1 || a[BIG/2] != 'x'){
+    printf("%s: read into untouched heap failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // untouched pages read as zero, in parent and child.
+  a[BIG-1] = 1;
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(a[0] != 0 || a[BIG/2] != 'x' || a[BIG-1] != 1)
+      exit(1);
+    a[BIG/4] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[BIG/4] != 0){
+    printf("%s: fork of lazy heap failed\n", s);
+    exit(1);
+  }
+
+  if(sbrk(-BIG) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(-BIG) failed\n", s);
+    exit(1);
+  }
+}
+
+// do O_DIRECT reads, which DMA whole uncached blocks into user
+// memory, return the same bytes as ordinary reads? the heap
+// buffer starts mid-page so that blocks straddle pages.
+void
+directread(char *s)
+{
+  enum { N = 3*BSIZE };
+  char *a, *b;
+  int fd, n1, n2, n;
+
+  a = sbrk(2*N + PGSIZE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  a += 100;
+  b = a + N;
+
+  // a program file that usertests never runs, so its blocks
+  // are probably not in the cache.
+  fd = open("bench", O_RDONLY|O_DIRECT);
+  if(fd < 0){
+    printf("%s: open bench failed\n", s);
+    exit(1);
+  }
+  n1 = 0;
+  while((n = read(fd, a + n1, N - n1)) > 0)
+    n1 += n;
+  close(fd);
+
+  fd = open("bench", O_RDONLY);
+  n2 = 0;
+  while((n = read(fd, b + n2, N - n2)) > 0)
+    n2 += n;
+  close(fd);
+
+  if(n1 == 0 || n1 != n2 || memcmp(a, b, n1) != 0){
+    printf("%s: O_DIRECT read differs (%d vs %d bytes)\n", s, n1, n2);
+    exit(1);
+  }
+
+  // a partial first block, then cached whole blocks.
+  fd = open("bench", O_RDONLY|O_DIRECT);
+  if(read(fd, a, 7) != 7 || read(fd, a + 7, n1 - 7) != n1 - 7 ||
+     memcmp(a, b, n1) != 0){
+    printf("%s: unaligned O_DIRECT read differs\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
+// does getdents() return every entry of a directory exactly
+// once, with the right type and size, however many at a time?
+void
+getdentstest(char *s)
+{
+  enum { N = 50 };
+  struct dirinfo di[7];
+  char name[8], seen[N];
+  int fd, i, j, n, ndot;
+
+  if(mkdir("gdd") != 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  strcpy(name, "gdd/f00");
+  for(i = 0; i < N; i++){
+    name[5] = '0' + i / 10;
+    name[6] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    write(fd, seen, i);  // a file of size i
+    close(fd);
+  }
+
+  memset(seen, 0, sizeof(seen));
+  ndot = 0;
+  fd = open("gdd", O_RDONLY);
+  while((n = getdents(fd, di, sizeof(di)/sizeof(di[0]))) > 0){
+    for(j = 0; j < n; j++){
+      if(strcmp(di[j].name, ".") == 0 || strcmp(di[j].name, "..") == 0){
+        if(di[j].type != T_DIR){
+          printf("%s: %s is not a directory\n", s, di[j].name);
+          exit(1);
+        }
+        ndot++;
+        continue;
+      }
+      i = (di[j].name[1] - '0') * 10 + di[j].name[2] - '0';
+      if(di[j].name[0] != 'f' || i < 0 || i >= N || seen[i] ||
+         di[j].type != T_FILE || di[j].size != i || di[j].nlink != 1){
+        printf("%s: bad entry %s\n", s, di[j].name);
+        exit(1);
+      }
+      seen[i] = 1;
+    }
+  }
+  close(fd);
+  if(n < 0 || ndot != 2){
+    printf("%s: getdents failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(!seen[i]){
+      printf("%s: entry %d missing\n", s, i);
+      exit(1);
+    }
+  }
+
+  // not a directory.
+  fd = open("gdd/f00", O_RDONLY);
+  if(getdents(fd, di, 1) != -1){
+    printf("%s: getdents on a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    name[5] = '0' + i / 10;
+    name[6] = '0' + i % 10;
+    unlink(name);
+  }
+  unlink("gdd");
+}
+
+#define NCLONE 4
+char clonestack[NCLONE][PGSIZE] __attribute__((aligned(16)));
+volatile int clonecount[NCLONE];
+volatile char *cloneheap;
+
+void
+clonefn(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  for(int j = 0; j < 1000; j++)
+    clonecount[i]++;
+  // a heap page that no one has touched yet.
+  cloneheap[i * PGSIZE] = 'a' + i;
+  if(i == 0){
+    // grow the shared memory for everyone.
+    char *a = sbrk(PGSIZE);
+    if(a == (char*)-1)
+      exit(1);
+    a[0] = 'z';
+  }
+  exit(10 + i);
+}
+
+// do threads made by clone() share memory, including heap
+// pages that they fault in and memory that one of them adds?
+void
+clonetest(char *s)
+{
+  int i, pid, xstatus, seen = 0;
+  char *top;
+
+  cloneheap = sbrk(NCLONE * PGSIZE);
+  top = sbrk(0);
+  for(i = 0; i < NCLONE; i++){
+    pid = clone(clonefn, (void*)(uint64)i, clonestack[i] + PGSIZE);
+    if(pid < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NCLONE; i++){
+    if(wait(&xstatus) < 0 || xstatus < 10 || xstatus >= 10 + NCLONE){
+      printf("%s: thread failed\n", s);
+      exit(1);
+    }
+    seen |= 1 << (xstatus - 10);
+  }
+  if(seen != (1 << NCLONE) - 1){
+    printf("%s: wrong exit statuses\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCLONE; i++){
+    if(clonecount[i] != 1000 || cloneheap[i * PGSIZE] != 'a' + i){
+      printf("%s: thread %d's writes not seen\n", s, i);
+      exit(1);
+    }
+  }
+  if(sbrk(0) != top + PGSIZE || top[0] != 'z'){
+    printf("%s: thread's sbrk not seen\n", s);
+    exit(1);
+  }
+}
+
+struct mutex futexmu;
+struct cond futexcv;
+volatile int futexsum, futexturn;
+
+void
+futexfn(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  for(int j = 0; j < 2000; j++){
+    mutex_lock(&futexmu);
+    futexsum++;  // not atomic; the mutex must keep others out
+    mutex_unlock(&futexmu);
+  }
+  // then take turns, in order of i.
+  mutex_lock(&futexmu);
+  while(futexturn != i)
+    cond_wait(&futexcv, &futexmu);
+  futexturn++;
+  cond_broadcast(&futexcv);
+  mutex_unlock(&futexmu);
+  exit(0);
+}
+
+// do the futex()-based mutex and condition variable keep
+// threads out of each other's way?
+void
+futextest(char *s)
+{
+  int i, xstatus, word = 1;
+
+  // wrong value: don't sleep.
+  if(futex(&word, FUTEX_WAIT, 0) != -1){
+    printf("%s: futex wait on wrong value succeeded\n", s);
+    exit(1);
+  }
+  if(futex(&word, FUTEX_WAKE, 1) != 0){
+    printf("%s: futex woke someone\n", s);
+    exit(1);
+  }
+
+  for(i = 0; i < NCLONE; i++){
+    if(clone(futexfn, (void*)(uint64)(NCLONE - 1 - i), clonestack[i] + PGSIZE) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NCLONE; i++){
+    if(wait(&xstatus) < 0 || xstatus != 0){
+      printf("%s: thread failed\n", s);
+      exit(1);
+    }
+  }
+  if(futexsum != NCLONE * 2000 || futexturn != NCLONE){
+    printf("%s: sum %d turn %d\n", s, futexsum, futexturn);
+    exit(1);
+  }
+}
+
+// do processes that map a shared memory segment, or inherit
+// it through fork(), see each other's writes, and can they
+// block on it with futex()?
+void
+shmtest(char *s)
+{
+  enum { KEY = 4711 };
+  char *a, *b;
+  volatile int *flag;
+  int pid, xstatus;
+
+  shmunlink(KEY);  // left over from a failed run?
+  if((a = shmmap(KEY, 2*PGSIZE)) == (char*)-1){
+    printf("%s: shmmap failed\n", s);
+    exit(1);
+  }
+  if(a != sbrk(0) - 2*PGSIZE || a[0] != 0 || a[PGSIZE] != 0){
+    printf("%s: bad new segment\n", s);
+    exit(1);
+  }
+  flag = (volatile int*)(a + 8);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // map it again, by name.
+    if((b = shmmap(KEY, PGSIZE)) == (char*)-1 || b == a)
+      exit(1);
+    b[0] = 'x';
+    a[PGSIZE] = 'y';  // inherited from the parent
+    *flag = 1;
+    futex((int*)flag, FUTEX_WAKE, 1);
+    exit(0);
+  }
+  while(*flag == 0)
+    futex((int*)flag, FUTEX_WAIT, 0);
+  wait(&xstatus);
+  if(xstatus != 0 || a[0] != 'x' || a[PGSIZE] != 'y'){
+    printf("%s: child's writes not seen\n", s);
+    exit(1);
+  }
+
+  // too big for the segment.
+  if(shmmap(KEY, 3*PGSIZE) != (char*)-1){
+    printf("%s: shmmap grew a segment\n", s);
+    exit(1);
+  }
+  if(shmunlink(KEY) != 0 || shmunlink(KEY) != -1){
+    printf("%s: shmunlink failed\n", s);
+    exit(1);
+  }
+  // still mapped here.
+  if(a[0] != 'x'){
+    printf("%s: unlinked segment lost\n", s);
+    exit(1);
+  }
+}
+
 // regression test. does write() with an invalid buffer pointer cause
 // a block to be allocated for a file that is then not freed when the
 // file is deleted? if the kernel has this bug, it will panic: balloc:
@@ -2860,6 +3234,12 @@ main(int argc, char *argv[])
     {sbrkarg, "sbrkarg"},
     {sbrklast, "sbrklast"},
     {sbrk8000, "sbrk8000"},
+    {lazysbrk, "lazysbrk"},
+    {directread, "directread"},
+    {getdentstest, "getdents"},
+    {clonetest, "clonetest"},
+    {futextest, "futextest"},
+    {shmtest, "shmtest"},
     {validatetest, "validatetest"},
     {stacktest, "stacktest"},
     {opentest, "opentest"},
@@ -40,4 +40,11 @@ entry("setSampleRate");
 entry("kwrite");
 entry("pause");
 entry("set_volume");
-entry("stop_wav");
\ No newline at end of file
+entry("stop_wav");
+entry("getdents");
+entry("setrt");
+entry("nanosleep");
+entry("clone");
+entry("futex");
+entry("shmmap");
+entry("shmunlink");
\ No newline at end of file